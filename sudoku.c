@@ -18,11 +18,12 @@
  * more human friendly, mechanism is needed.
  *
  * Comments, suggestions, and contributions are always welcome - send email
- * to: mike 'at' laurasia.com.au. Note that this code assumes a single
- * threaded process, makes extensive use of global variables, and has
- * not been written to be reused in other applications. The code makes no
- * use of dynamic memory allocation, and hence, requires no heap. It should
- * also run with minimal stack space.
+ * to: mike 'at' laurasia.com.au. Note that the user interface assumes a
+ * single threaded process, and makes extensive use of global variables;
+ * the solver keeps all of its state in a solver context (c.f. solver_t),
+ * but has not been written to be reused in other applications. The code
+ * makes no use of dynamic memory allocation, and hence, requires no heap.
+ * It should also run with minimal stack space.
  *
  * This code and accompanying files have been placed into the public domain
  * by Michael Kennett, July 2005. It is provided without any warranty
@@ -43,6 +44,36 @@
 #include <curses.h>
 #include <stddef.h>
 
+/* Vectorised propagation (c.f. findmoves()) is compiled with gcc/clang
+ * on x86, and used only if the processor supports AVX2 at run time.
+ * Define NO_AVX2 to build just the portable code.
+ */
+#if !defined (NO_AVX2) && defined (__GNUC__) \
+    && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+/* Parallel search (c.f. count_parallel()) uses POSIX threads, and the
+ * gcc/clang atomic builtins. Define NO_THREADS to build without.
+ */
+#if !defined (NO_THREADS) && defined (__GNUC__) && !defined (_WIN32)
+#define HAVE_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* Forced inlining, for the routines that walk one kind of unit and
+ * rely on a constant kind to fold (c.f. UNIT_CELL)
+ */
+#if defined (__GNUC__)
+#define INLINE                  __inline__ __attribute__((always_inline))
+#elif defined (_MSC_VER)
+#define INLINE                  __forceinline
+#else
+#define INLINE
+#endif
+
 /* Default file locations */
 #if !defined (TEMPLATE)
 #define TEMPLATE "/usr/share/sudoku/template"
@@ -290,13 +321,6 @@ static time_t start_time;
 #define HINT_COLUMN             0x02000000
 #define HINT_BLOCK              0x04000000
 
-/* For a general board it may be necessary to do backtracking (i.e. to
- * rewind the board to an earlier state), and make choices during the
- * solution process. This can be implemented naturally using recursion,
- * but it is more efficient to maintain a single board.
- */
-static int board[81];
-
 /* Addressing board elements: linear array 0..80 */
 #define ROW(idx)                ((idx)/9)
 #define COLUMN(idx)             ((idx)%9)
@@ -307,15 +331,245 @@ static int board[81];
 #define IDX_BLOCK(row,col)      (3*((row)/3)+((col)/3))
 #define TOP_LEFT(block)         (INDEX(block/3,block%3))
 
-/* Board state */
-#define STATE(idx)              ((board[idx])&STATE_MASK)
-#define DIGIT(idx)              (GET_DIGIT(board[idx]))
-#define HINT(idx)               ((board[idx])&HINT_MASK)
-#define IS_EMPTY(idx)           (0 == DIGIT(idx))
-#define DISALLOWED(idx,digit)   ((board[idx])&DIGIT_STATE(digit))
-#define IS_FIXED(idx)           (board[idx]&FIXED)
-
-/* Record move history, and maintain a counter for the current
+/* Squares of each unit, numbered as for solver_t.used: rows 0..8,
+ * columns 9..17 and blocks 18..26, then the houses that variants add
+ * (c.f. solver_t.houses). Walking a unit is a table lookup rather than
+ * a call through an index function.
+ */
+#define MAX_UNITS               (27 + 15)
+
+static const unsigned char unit_cell[MAX_UNITS][9] = {
+    /* rows */
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8},
+    { 9, 10, 11, 12, 13, 14, 15, 16, 17},
+    {18, 19, 20, 21, 22, 23, 24, 25, 26},
+    {27, 28, 29, 30, 31, 32, 33, 34, 35},
+    {36, 37, 38, 39, 40, 41, 42, 43, 44},
+    {45, 46, 47, 48, 49, 50, 51, 52, 53},
+    {54, 55, 56, 57, 58, 59, 60, 61, 62},
+    {63, 64, 65, 66, 67, 68, 69, 70, 71},
+    {72, 73, 74, 75, 76, 77, 78, 79, 80},
+    /* columns */
+    { 0,  9, 18, 27, 36, 45, 54, 63, 72},
+    { 1, 10, 19, 28, 37, 46, 55, 64, 73},
+    { 2, 11, 20, 29, 38, 47, 56, 65, 74},
+    { 3, 12, 21, 30, 39, 48, 57, 66, 75},
+    { 4, 13, 22, 31, 40, 49, 58, 67, 76},
+    { 5, 14, 23, 32, 41, 50, 59, 68, 77},
+    { 6, 15, 24, 33, 42, 51, 60, 69, 78},
+    { 7, 16, 25, 34, 43, 52, 61, 70, 79},
+    { 8, 17, 26, 35, 44, 53, 62, 71, 80},
+    /* blocks */
+    { 0,  1,  2,  9, 10, 11, 18, 19, 20},
+    { 3,  4,  5, 12, 13, 14, 21, 22, 23},
+    { 6,  7,  8, 15, 16, 17, 24, 25, 26},
+    {27, 28, 29, 36, 37, 38, 45, 46, 47},
+    {30, 31, 32, 39, 40, 41, 48, 49, 50},
+    {33, 34, 35, 42, 43, 44, 51, 52, 53},
+    {54, 55, 56, 63, 64, 65, 72, 73, 74},
+    {57, 58, 59, 66, 67, 68, 75, 76, 77},
+    {60, 61, 62, 69, 70, 71, 78, 79, 80},
+    /* diagonals (houses of the 'diagonal' variant) */
+    { 0, 10, 20, 30, 40, 50, 60, 70, 80},
+    { 8, 16, 24, 32, 40, 48, 56, 64, 72},
+    /* windows ('windoku') */
+    {10, 11, 12, 19, 20, 21, 28, 29, 30},
+    {14, 15, 16, 23, 24, 25, 32, 33, 34},
+    {46, 47, 48, 55, 56, 57, 64, 65, 66},
+    {50, 51, 52, 59, 60, 61, 68, 69, 70},
+    /* disjoint groups ('disjoint'): the same square of each block */
+    { 0,  3,  6, 27, 30, 33, 54, 57, 60},
+    { 1,  4,  7, 28, 31, 34, 55, 58, 61},
+    { 2,  5,  8, 29, 32, 35, 56, 59, 62},
+    { 9, 12, 15, 36, 39, 42, 63, 66, 69},
+    {10, 13, 16, 37, 40, 43, 64, 67, 70},
+    {11, 14, 17, 38, 41, 44, 65, 68, 71},
+    {18, 21, 24, 45, 48, 51, 72, 75, 78},
+    {19, 22, 25, 46, 49, 52, 73, 76, 79},
+    {20, 23, 26, 47, 50, 53, 74, 77, 80}
+};
+
+/* Row, column and block unit of each square */
+static const unsigned char cell_unit[81][3] = {
+    { 0, 9,18}, { 0,10,18}, { 0,11,18}, { 0,12,19}, { 0,13,19},
+    { 0,14,19}, { 0,15,20}, { 0,16,20}, { 0,17,20},
+    { 1, 9,18}, { 1,10,18}, { 1,11,18}, { 1,12,19}, { 1,13,19},
+    { 1,14,19}, { 1,15,20}, { 1,16,20}, { 1,17,20},
+    { 2, 9,18}, { 2,10,18}, { 2,11,18}, { 2,12,19}, { 2,13,19},
+    { 2,14,19}, { 2,15,20}, { 2,16,20}, { 2,17,20},
+    { 3, 9,21}, { 3,10,21}, { 3,11,21}, { 3,12,22}, { 3,13,22},
+    { 3,14,22}, { 3,15,23}, { 3,16,23}, { 3,17,23},
+    { 4, 9,21}, { 4,10,21}, { 4,11,21}, { 4,12,22}, { 4,13,22},
+    { 4,14,22}, { 4,15,23}, { 4,16,23}, { 4,17,23},
+    { 5, 9,21}, { 5,10,21}, { 5,11,21}, { 5,12,22}, { 5,13,22},
+    { 5,14,22}, { 5,15,23}, { 5,16,23}, { 5,17,23},
+    { 6, 9,24}, { 6,10,24}, { 6,11,24}, { 6,12,25}, { 6,13,25},
+    { 6,14,25}, { 6,15,26}, { 6,16,26}, { 6,17,26},
+    { 7, 9,24}, { 7,10,24}, { 7,11,24}, { 7,12,25}, { 7,13,25},
+    { 7,14,25}, { 7,15,26}, { 7,16,26}, { 7,17,26},
+    { 8, 9,24}, { 8,10,24}, { 8,11,24}, { 8,12,25}, { 8,13,25},
+    { 8,14,25}, { 8,15,26}, { 8,16,26}, { 8,17,26}
+};
+
+/* Houses of each square, if any (ending with 0 if fewer than 3) */
+static const unsigned char cell_house[81][3] = {
+    {27,33, 0}, {34, 0, 0}, {35, 0, 0}, {33, 0, 0}, {34, 0, 0}, {35, 0, 0},
+    {33, 0, 0}, {34, 0, 0}, {28,35, 0}, {36, 0, 0}, {27,29,37}, {29,38, 0},
+    {29,36, 0}, {37, 0, 0}, {30,38, 0}, {30,36, 0}, {28,30,37}, {38, 0, 0},
+    {39, 0, 0}, {29,40, 0}, {27,29,41}, {29,39, 0}, {40, 0, 0}, {30,41, 0},
+    {28,30,39}, {30,40, 0}, {41, 0, 0}, {33, 0, 0}, {29,34, 0}, {29,35, 0},
+    {27,29,33}, {34, 0, 0}, {28,30,35}, {30,33, 0}, {30,34, 0}, {35, 0, 0},
+    {36, 0, 0}, {37, 0, 0}, {38, 0, 0}, {36, 0, 0}, {27,28,37}, {38, 0, 0},
+    {36, 0, 0}, {37, 0, 0}, {38, 0, 0}, {39, 0, 0}, {31,40, 0}, {31,41, 0},
+    {28,31,39}, {40, 0, 0}, {27,32,41}, {32,39, 0}, {32,40, 0}, {41, 0, 0},
+    {33, 0, 0}, {31,34, 0}, {28,31,35}, {31,33, 0}, {34, 0, 0}, {32,35, 0},
+    {27,32,33}, {32,34, 0}, {35, 0, 0}, {36, 0, 0}, {28,31,37}, {31,38, 0},
+    {31,36, 0}, {37, 0, 0}, {32,38, 0}, {32,36, 0}, {27,32,37}, {38, 0, 0},
+    {28,39, 0}, {40, 0, 0}, {41, 0, 0}, {39, 0, 0}, {40, 0, 0}, {41, 0, 0},
+    {39, 0, 0}, {40, 0, 0}, {27,41, 0}
+};
+
+/* Variants: the houses each turns on, as bits of solver_t.houses, for
+ * unit 27 + bit (c.f. read_board())
+ */
+#define HOUSE_BIT(unit)         (1 << ((unit) - 27))
+#define VARIANTS                3
+
+static const char * const variant_name[VARIANTS] = {
+    "diagonal", "windoku", "disjoint"
+};
+static const int variant_houses[VARIANTS] = {
+    0x0003, 0x003c, 0x7fc0
+};
+
+#define ROW_UNIT(idx)           (cell_unit[idx][0])
+#define COLUMN_UNIT(idx)        (cell_unit[idx][1])
+#define BLOCK_UNIT(idx)         (cell_unit[idx][2])
+
+/* Kinds of unit: rows, columns, blocks, then the variant houses. The
+ * square 'i' of a row, column or block unit is computed from the unit
+ * number, so that with a constant kind the unit routines unroll to
+ * fixed offsets from the first square; only a house is looked up.
+ */
+#define KIND_ROW                0
+#define KIND_COLUMN             1
+#define KIND_BLOCK              2
+#define KIND_HOUSE              3
+#define UNIT_KIND(unit)         ((unit) < 27 ? (unit)/9 : KIND_HOUSE)
+
+#define UNIT_CELL(kind,unit,i)  (KIND_ROW == (kind)                        \
+                                 ? INDEX(unit,i)                           \
+                                 : KIND_COLUMN == (kind)                   \
+                                 ? INDEX(i,(unit)-9)                       \
+                                 : KIND_BLOCK == (kind)                    \
+                                 ? 27*(((unit)-18)/3)+3*(((unit)-18)%3)    \
+                                   +INDEX((i)/3,(i)%3)                     \
+                                 : unit_cell[unit][i])
+
+/* Zobrist hash of the digits filled in (c.f. init_zobrist()) */
+#if defined (_MSC_VER)
+typedef unsigned __int64 zkey_t;
+#define strtozkey _strtoui64
+#else
+typedef unsigned long long zkey_t;
+#define strtozkey strtoull
+#endif
+
+/* Copy-on-choice snapshot of the board, pushed by choose() and popped
+ * by backtrack(); this is the board that reapply() would construct from
+ * the move history preceding the choice, so restoring it is equivalent
+ * to (but much cheaper than) replaying the history.
+ */
+typedef struct snapshot_s {
+    int             idx_history;    /* Position of the choice in history */
+    int             unit;           /* Unit of a digit choice, else -1   */
+    zkey_t          hash;           /* c.f. solver_t                     */
+    int             used[MAX_UNITS];/* c.f. solver_t                     */
+    unsigned char   cell[81];       /* Digit, and SNAP_FIXED if fixed    */
+} snapshot_t;
+
+#define SNAP_FIXED              0x10
+
+/* Set of choice levels 1..81 (c.f. backjump()) */
+typedef struct levels_s {
+    unsigned int    w[3];
+} levels_t;
+
+/* A learned nogood: choices (9 * idx + digit - 1) that cannot all hold */
+#define NOGOODS                 64
+#define NOGOOD_SIZE             8
+
+typedef struct nogood_s {
+    int             n;
+    short           lit[NOGOOD_SIZE];
+} nogood_t;
+
+/* Dancing links for the exact cover formulation (c.f. dlx_search()).
+ * Node 0 is the root, nodes 1..324 head the columns (one per square,
+ * and one per digit in each row, column and block, then in each house
+ * turned on), and each of the 729 candidates (square, digit) has a row
+ * of 4 nodes, and one more per house of the square turned on; rows
+ * are 'width' nodes apart, 4 without houses.
+ */
+#define DLX_COLUMNS             (4 * 81 + 9 * (MAX_UNITS - 27))
+#define DLX_ROWS                729
+#define DLX_WIDTH               (4 + 3)
+#define DLX_FIRST_ROW           (1 + DLX_COLUMNS)
+#define DLX_NODES               (DLX_FIRST_ROW + DLX_WIDTH * DLX_ROWS)
+
+typedef struct dlx_s {
+    short   l[DLX_NODES];           /* Left, right, up and down links    */
+    short   r[DLX_NODES];
+    short   u[DLX_NODES];
+    short   d[DLX_NODES];
+    short   c[DLX_NODES];           /* Column header of each node        */
+    short   s[DLX_FIRST_ROW];       /* # nodes in each column            */
+    short   o[81];                  /* Row node chosen at each level     */
+    char    forced[81];             /* Set if the column had just 1 row  */
+    int     level;                  /* # rows chosen                     */
+    int     width;                  /* Nodes from one row to the next    */
+    int     base;                   /* Moves in the history when started */
+    int     state;                  /* DLX_IDLE, DLX_SOLVED, DLX_RESUME  */
+} dlx_t;
+
+#define DLX_IDLE                0   /* Must be (re)built from the board  */
+#define DLX_SOLVED              1   /* Board holds the current solution  */
+#define DLX_RESUME              2   /* Continue after the last solution  */
+
+/* Strategies beyond those used to classify boards (c.f. allmoves()) */
+#define STRATEGY_FISH           0x01
+#define STRATEGY_SUBSETS        0x02    /* Replaces pairs(), position2() */
+#define STRATEGY_PROBE          0x04    /* Look-ahead before a choice     */
+#define STRATEGY_BACKJUMP       0x08    /* Conflict-directed backjumping  */
+
+/* Branching policies (c.f. choice()) */
+enum branch_enum {
+    bMRV,                           /* Square with fewest digits allowed */
+    bDegree,                        /* .. then most unknown neighbours   */
+    bDigit                          /* .. or digit with fewest positions */
+};
+
+/* Solver engines (c.f. engine_solve()) */
+enum engine_enum {
+    eSearch,                        /* Deterministic solver + choices    */
+    eDLX,                           /* Dancing links exact cover         */
+    eBackjump,                      /* Singles, and backjumping          */
+    eAuto                           /* One of the above for each board   */
+};
+
+/* Solver context - everything the solver needs to work on a board.
+ * The solver routines never touch global state, and take the context
+ * as their first argument; one context per thread is sufficient to
+ * run several solvers concurrently in the same process. The game
+ * itself (and the single threaded command line modes) use the default
+ * context 'solver' below.
+ *
+ * For a general board it may be necessary to do backtracking (i.e. to
+ * rewind the board to an earlier state), and make choices during the
+ * solution process. This can be implemented naturally using recursion,
+ * but it is more efficient to maintain a single board.
+ *
+ * The move history records moves, and a counter for the current
  * move number. Concessions are made for the user interface, and
  * allow digit 0 to indicate clearing a square. The move history
  * is used to support 'undo's for the user interface, and hence
@@ -323,27 +577,125 @@ static int board[81];
  * the puzzle, undo every move, and then redo the puzzle - and
  * if the user requires more space, then the full history will be
  * lost.
+ *
+ * Possible moves for a given board (c.f. findmoves()) are also used
+ * by choice() when the deterministic solver has failed, and for
+ * calculating user hints.
+ *
+ * The state bits of a square only record the digits masked by the
+ * refining strategies (c.f. pairs()); the digits used in each row,
+ * column and block are kept once per unit in 'used' (rows 0-8,
+ * columns 9-17, blocks 18-26), and merged in by STATE().
+ *
+ * A variant adds houses (units 27 on, c.f. unit_cell) to the board,
+ * turned on in 'houses'. Their digits are kept in 'used' too, but are
+ * masked in the state bits of the other squares of the house as they
+ * are filled (c.f. update()), so that STATE() costs the same with or
+ * without them; anything which drops the state bits masks them again
+ * (c.f. mask_houses()).
+ */
+typedef struct solver_s {
+    int     board[81];
+    int     idx_history;
+    int     history[3 * 81];
+    int     idx_possible;
+    int     possible[81];
+    int     pass;           /* count # passes of deterministic solver   */
+    int     strategies;     /* STRATEGY_* used beyond the classic ones  */
+    int     used[MAX_UNITS];/* Digits used in rows, columns, blocks ..  */
+    int     houses;         /* .. and the houses of variants turned on  */
+    zkey_t  hash;           /* Zobrist hash of the digits filled in     */
+    int     digits[9];      /* # digits expressed in element square     */
+    int     once;           /* Digits allowed somewhere in element      */
+    int     twice;          /* Digits allowed twice or more in element  */
+    int     present;        /* Digits already placed in element         */
+    int     posn_digit[10]; /* Positions of a digit (c.f. position2())  */
+    int     depth;          /* # snapshots on the stack                 */
+    snapshot_t stack[81];   /* Snapshots for each choice point          */
+    levels_t dep[81];       /* Choices each filled square depends on    */
+    levels_t conflict[82];  /* Choices to blame when a level runs out   */
+    int     idx_nogood;     /* Next slot to learn a nogood into         */
+    nogood_t nogood[NOGOODS];
+    enum engine_enum engine;/* Used for counting/enumerating solutions  */
+    enum branch_enum branching;
+    int     branch_unit;    /* Digit choice found by choice(), or -1    */
+    int     branch_digit;
+    unsigned char rank_shift[10];  /* Order guesses try digits in, and */
+    unsigned char digit_shift[10]; /* .. its inverse (c.f. RANK_DIGIT()) */
+    int     guesses;        /* # guesses made (c.f. push_snapshot())    */
+    int     budget;         /* solve() gives up after this # guesses    */
+    dlx_t   dlx;
+} solver_t;
+
+static solver_t solver;     /* Default context */
+
+/* Zobrist keys of each digit in each square (c.f. init_zobrist()),
+ * and of each digit in each house of a variant, key 0 of which is for
+ * the house being turned on
+ */
+static zkey_t zobrist[81][10];
+static zkey_t zobrist_house[MAX_UNITS - 27][10];
+
+/* Transposition table of the solutions counted below a board (c.f.
+ * count_completions()); the count is exact, or a lower bound if the
+ * count stopped at its limit. Any board with the same hash has the
+ * same completions (c.f. init_zobrist()), so entries remain valid from
+ * board to board.
+ *
+ * An entry keeps the count and bound in 'data', and the hash xor'ed
+ * with that: threads may update an entry while another reads it, and
+ * a torn read then just fails to match (c.f. tt_probe()).
  */
-static int idx_history;
-static int history[3 * 81];
+#define TT_BITS                 20
+#define TT_EMPTY                0
+#define TT_EXACT                1
+#define TT_LOWER                2
+
+typedef struct tt_entry_s {
+    zkey_t  check;                  /* Hash ^ data                       */
+    zkey_t  data;                   /* Count, and bound << 32            */
+} tt_entry_t;
+
+static tt_entry_t ttable[1 << TT_BITS];
+
+#if defined (HAVE_THREADS)
+#define TT_LOAD(p)              __atomic_load_n(p, __ATOMIC_RELAXED)
+#define TT_STORE(p,v)           __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#else
+#define TT_LOAD(p)              (*(p))
+#define TT_STORE(p,v)           (*(p) = (v))
+#endif
 
-/* Possible moves for a given board (c.f. fillmoves()).
- * Also used by choice() when the deterministic solver has failed,
- * and for calculating user hints. The number of hints is stored
- * in num_hints, or -1 if no hints calculated. The number of hints
- * requested by the user since their last move is stored in req_hints;
- * if the user keeps requesting hints, start giving more information.
- * Finally, record the last hint issued to the user; attempt to give
- * different hints each time.
+/* Board state */
+#define USED(sv,idx)              ((sv)->used[ROW_UNIT(idx)]     \
+                                   |(sv)->used[COLUMN_UNIT(idx)] \
+                                   |(sv)->used[BLOCK_UNIT(idx)])
+#define STATE(sv,idx)             (((sv)->board[idx]|USED(sv,idx))&STATE_MASK)
+#define DIGIT(sv,idx)             (GET_DIGIT((sv)->board[idx]))
+#define HINT(sv,idx)              (((sv)->board[idx])&HINT_MASK)
+#define IS_EMPTY(sv,idx)          (0 == DIGIT(sv,idx))
+#define DISALLOWED(sv,idx,digit)  (STATE(sv,idx)&DIGIT_STATE(digit))
+#define IS_FIXED(sv,idx)          ((sv)->board[idx]&FIXED)
+
+/* Order in which guesses try digits: rank 1..9 <-> digit. The order is
+ * kept as shifts of each rank and digit, so that a context cleared to
+ * zeros tries the digits 1..9 in turn (c.f. order_digits()).
+ */
+#define RANK_DIGIT(sv,rank)       (1 + ((rank) - 1                    \
+                                        + (sv)->rank_shift[rank]) % 9)
+#define DIGIT_RANK(sv,digit)      (1 + ((digit) - 1                   \
+                                        + (sv)->digit_shift[digit]) % 9)
+
+/* The number of hints is stored in num_hints, or -1 if no hints
+ * calculated. The number of hints requested by the user since their
+ * last move is stored in req_hints; if the user keeps requesting hints,
+ * start giving more information. Finally, record the last hint issued
+ * to the user; attempt to give different hints each time.
  */
-static int idx_possible;
-static int possible[81];
 static int num_hints;
 static int req_hints;
 static int last_hint;
 
-static int pass;    /* count # passes of deterministic solver */
-
 /* Support for template file */
 static FILE * ftmplt;
 static int n_tmplt;                 /* Number of templates in file */
@@ -368,6 +720,21 @@ static int opt_statistics = 0;
 static int opt_spoilerhint = 0;
 static int opt_solve = 0;
 static int opt_restrict = 0;
+static enum engine_enum opt_engine = eSearch;
+static int opt_count = 0;           /* Solutions to count with -s */
+static int opt_lookahead = 0;
+static int opt_restarts = 0;        /* Base guess budget for -g attempts */
+static enum branch_enum opt_branching = bMRV;
+static int opt_threads = 1;         /* Threads counting solutions (-p) */
+static int opt_jobs = 1;            /* Threads taking boards in turn (-j) */
+static int opt_cubes = 0;           /* Cubes to split boards into (-k) */
+static const char * opt_board = 0;  /* Title of the only board (-b) */
+static const char * opt_merge = 0;  /* File of cube counts to merge (-m) */
+static int opt_grid_rows = 0;       /* Box of boards other than 9x9 (-G) */
+static int opt_grid_cols = 0;
+static const char * opt_lines = 0;  /* File of boards, one per line (-L) */
+static int opt_seeded = 0;          /* Seed of the boards given (-S) */
+static long opt_first = 0;          /* Number of the first board (-S) */
 
 static FILE default_template_file;  /* We will use only the address of it. */
 static int default_template_siz = 0;
@@ -518,33 +885,65 @@ write_default_template(const char *     template_path)
     return ret;
 }
 
-/* Reset global state */
+/* Hash of an empty board with the given houses turned on */
+static
+zkey_t
+houses_key (int houses)
+{
+    zkey_t hash = 0;
+    int i;
+
+    for (i = 27; 0 != houses && i < MAX_UNITS; ++i) {
+        if (0 != (houses & HOUSE_BIT(i))) {
+            hash ^= zobrist_house[i - 27][0];
+        }
+    }
+    return hash;
+}
+
+/* Reset solver state; the houses turned on are kept */
 static
 void
-reset (void)
+reset (solver_t * sv)
 {
-    memset(board, 0x00, sizeof(board));
-    memset(history, 0x00, sizeof(history));
-    idx_history = 0;
-    pass = 0;
+    memset(sv->board, 0x00, sizeof(sv->board));
+    memset(sv->used, 0x00, sizeof(sv->used));
+    memset(sv->history, 0x00, sizeof(sv->history));
+    sv->idx_history = 0;
+    sv->hash = houses_key(sv->houses);
+    sv->depth = 0;
+    sv->dlx.state = DLX_IDLE;
+    sv->pass = 0;
+    memset(sv->dep, 0x00, sizeof(sv->dep));
+    memset(sv->nogood, 0x00, sizeof(sv->nogood));
+    sv->idx_nogood = 0;
 }
 
 /* Write text representation to given file */
 static
 void
-text (FILE * f, const char * title)
+text (const solver_t * sv, FILE * f, const char * title)
 {
     int i;
     if (fCSV != opt_format) {
         if (0 != title) {
             fprintf(f, "%% %s\n", title);
         }
+        if (0 != sv->houses) {
+            fprintf(f, "#variant");
+            for (i = 0; i < VARIANTS; ++i) {
+                if (variant_houses[i] == (sv->houses & variant_houses[i])) {
+                    fprintf(f, " %s", variant_name[i]);
+                }
+            }
+            fprintf(f, "\n");
+        }
         for (i = 0; i < 81; ++i) {
-            if (IS_EMPTY(i)) {
+            if (IS_EMPTY(sv, i)) {
                 fprintf(f, fStandard == opt_format ? " ." : ".");
             } else {
                 fprintf(f, fStandard == opt_format ? "%2d" : "%d",
-                            GET_DIGIT(board[i]));
+                            GET_DIGIT(sv->board[i]));
             }
             if (8 == COLUMN(i)) {
                 fprintf(f, "\n");
@@ -557,8 +956,8 @@ text (FILE * f, const char * title)
         }
     } else {
         for (i = 0; i < 81; ++i) {
-            if (!IS_EMPTY(i)) {
-                fprintf (f, "%d", GET_DIGIT(board[i]));
+            if (!IS_EMPTY(sv, i)) {
+                fprintf (f, "%d", GET_DIGIT(sv->board[i]));
             }
             if (8 == COLUMN(i)) {
                 fprintf(f, "\n");
@@ -572,7 +971,7 @@ text (FILE * f, const char * title)
 /* Write PostScript representation to given file */
 static
 void
-postscript (FILE * f, const char * title)
+postscript (const solver_t * sv, FILE * f, const char * title)
 {
 #define PS_WIDTH          20   /* Size of each box (points) */
 #define PS_MARGIN         5    /* Margin around board (points) */
@@ -614,8 +1013,8 @@ postscript (FILE * f, const char * title)
     /* Write the board contents as a string */
     fprintf(f, "(");
     for (i = 0; i < 81; ++i) {
-        if (!IS_EMPTY(i)) {
-            fprintf(f, "%d", GET_DIGIT(board[i]));
+        if (!IS_EMPTY(sv, i)) {
+            fprintf(f, "%d", GET_DIGIT(sv->board[i]));
         } else {
             fprintf(f, " ");
         }
@@ -687,7 +1086,7 @@ postscript (FILE * f, const char * title)
 
 static
 void
-html (FILE * f, const char * title)
+html (const solver_t * sv, FILE * f, const char * title)
 {
     int i;
 
@@ -708,10 +1107,10 @@ html (FILE * f, const char * title)
             fprintf(f, "<tr>");
         }
         fprintf(f, "<td>");
-        if (IS_EMPTY(i)) {
+        if (IS_EMPTY(sv, i)) {
             fprintf(f, "&nbsp;&nbsp;&nbsp;");
         } else {
-            fprintf(f, "&nbsp;%d&nbsp;", GET_DIGIT(board[i]));
+            fprintf(f, "&nbsp;%d&nbsp;", GET_DIGIT(sv->board[i]));
         }
         fprintf(f, "</td>");
         if (8 == i % 9) {
@@ -726,19 +1125,19 @@ html (FILE * f, const char * title)
 
 static
 void
-print (FILE * f, const char * title)
+print (const solver_t * sv, FILE * f, const char * title)
 {
     switch (opt_format) {
         case fStandard:
         case fCompact:
         case fCSV:
-            text(f, title);
+            text(sv, f, title);
             break;
         case fPostScript:
-            postscript(f, title);
+            postscript(sv, f, title);
             break;
         case fHTML:
-            html(f, title);
+            html(sv, f, title);
             break;
     }
 }
@@ -746,18 +1145,18 @@ print (FILE * f, const char * title)
 /* Describe solution history */
 static
 void
-describe (FILE * f)
+describe (const solver_t * sv, FILE * f)
 {
     int i, j;
-    for (i = j = 0; i < idx_history; ++i) {
-        if (0 == (history[i] & FIXED)) {
-            if (i < idx_history && 0 < j) {
+    for (i = j = 0; i < sv->idx_history; ++i) {
+        if (0 == (sv->history[i] & FIXED)) {
+            if (i < sv->idx_history && 0 < j) {
                 fprintf(f, 0 == j % 6 ? "\n" : ", ");
             }
-            fprintf(f, "%d %c> (%d,%d)", GET_DIGIT(history[i]),
-                                      history[i] & CHOICE ? '*' : '-',
-                                      1 + ROW(GET_INDEX(history[i])),
-                                      1 + COLUMN(GET_INDEX(history[i])));
+            fprintf(f, "%d %c> (%d,%d)", GET_DIGIT(sv->history[i]),
+                                      sv->history[i] & CHOICE ? '*' : '-',
+                                      1 + ROW(GET_INDEX(sv->history[i])),
+                                      1 + COLUMN(GET_INDEX(sv->history[i])));
             ++j;
         }
     }
@@ -767,92 +1166,109 @@ describe (FILE * f)
 /* Management of the move history - compression */
 static
 void
-compress(int limit)
+compress (solver_t * sv, int limit)
 {
     int i, j, k;
     /* Find the first ignored history item, if there is any. */
-    for (k = 0; k < idx_history; ++k) {
-        if (0 != (history[k] & IGNORED)) {
+    for (k = 0; k < sv->idx_history; ++k) {
+        if (0 != (sv->history[k] & IGNORED)) {
             break;
         }
     }
     /* Move the rest to compress the history */
-    for (i = j = k; i < idx_history && j < limit; ++i) {
-        if (!(history[i] & IGNORED)) {
-            history[j++] = history[i];
+    for (i = j = k; i < sv->idx_history && j < limit; ++i) {
+        if (!(sv->history[i] & IGNORED)) {
+            sv->history[j++] = sv->history[i];
         }
     }
-    for (; i < idx_history; ++i) {
-        history[j++] = history[i];
+    for (; i < sv->idx_history; ++i) {
+        sv->history[j++] = sv->history[i];
     }
-    idx_history = j;
+    sv->idx_history = j;
+}
+
+/* Management of the move history - appending a move. The solver only
+ * ever fills empty squares, so it has no earlier references to ignore.
+ */
+static
+void
+append_move (solver_t * sv, int idx, int digit, int choice)
+{
+    if (sizeof(sv->history) / sizeof(int) - 1 <= sv->idx_history) {
+        compress(sv, 81);
+    }
+    sv->history[sv->idx_history++] = SET_INDEX(idx)
+                                     | SET_DIGIT(digit)
+                                     | choice;
 }
 
 /* Management of the move history - adding a move */
 static
 void
-add_move (int idx, int digit, int choice)
+add_move (solver_t * sv, int idx, int digit, int choice)
 {
     int i;
 
-    if (sizeof(history) / sizeof(int) - 1 <= idx_history) {
-        compress(81);
-    }
     /* Never ignore the last move */
-    history[idx_history++] = SET_INDEX(idx) | SET_DIGIT(digit) | choice;
+    append_move(sv, idx, digit, choice);
 
     /* Ignore all previous references to idx */
-    for (i = idx_history - 2; 0 <= i; --i) {
-        if (GET_INDEX(history[i]) == idx) {
-            history[i] |= IGNORED;
+    for (i = sv->idx_history - 2; 0 <= i; --i) {
+        if (GET_INDEX(sv->history[i]) == idx) {
+            sv->history[i] |= IGNORED;
             break;
         }
     }
 }
 
-/* Iteration over rows/columns/blocks handled by specialised code.
- * Each function returns a block index - call must manage element/idx.
+/* Update board state after setting a digit (clearing not handled)
  */
 static
-int
-idx_row (int el, int idx)      /* Index within a row */
+void
+update (solver_t * sv, int idx)
 {
-    return INDEX(el, idx);
-}
+    const int mask = DIGIT_STATE(DIGIT(sv, idx));
 
-static
-int
-idx_column (int el, int idx)   /* Index within a column */
-{
-    return INDEX (idx, el);
-}
+    sv->board[idx] |= STATE_MASK;  /* filled - no choice possible */
+    sv->hash ^= zobrist[idx][DIGIT(sv, idx)];
 
-static
-int
-idx_block (int el, int idx)    /* Index within a block */
-{
-    return INDEX(3 * (el / 3) + idx / 3, 3 * (el % 3) + idx % 3);
+    /* Digit cannot appear in row, column or block */
+    sv->used[ROW_UNIT(idx)] |= mask;
+    sv->used[COLUMN_UNIT(idx)] |= mask;
+    sv->used[BLOCK_UNIT(idx)] |= mask;
+
+    /* .. nor in the other squares of its houses */
+    if (0 != sv->houses) {
+        int i, k, unit;
+        for (k = 0; k < 3 && 0 != (unit = cell_house[idx][k]); ++k) {
+            if (0 != (sv->houses & HOUSE_BIT(unit))) {
+                sv->used[unit] |= mask;
+                sv->hash ^= zobrist_house[unit - 27][DIGIT(sv, idx)];
+                for (i = 0; i < 9; ++i) {
+                    sv->board[unit_cell[unit][i]] |= mask;
+                }
+            }
+        }
+    }
 }
 
-/* Update board state after setting a digit (clearing not handled)
+/* Mask the digits used in each house turned on in its empty squares,
+ * after their state bits were dropped (c.f. update())
  */
 static
 void
-update (int idx)
+mask_houses (solver_t * sv)
 {
-    const int row = ROW(idx);
-    const int col = COLUMN(idx);
-    const int block = IDX_BLOCK(row, col);
-    const int mask = DIGIT_STATE(DIGIT(idx));
-    int i;
+    int i, unit;
 
-    board[idx] |= STATE_MASK;  /* filled - no choice possible */
-
-    /* Digit cannot appear in row, column or block */
-    for (i = 0; i < 9; ++i) {
-        board[idx_row(row, i)] |= mask;
-        board[idx_column(col, i)] |= mask;
-        board[idx_block(block, i)] |= mask;
+    for (unit = 27; 0 != sv->houses && unit < MAX_UNITS; ++unit) {
+        if (0 != (sv->houses & HOUSE_BIT(unit))) {
+            for (i = 0; i < 9; ++i) {
+                if (IS_EMPTY(sv, unit_cell[unit][i])) {
+                    sv->board[unit_cell[unit][i]] |= sv->used[unit];
+                }
+            }
+        }
     }
 }
 
@@ -862,23 +1278,31 @@ update (int idx)
  */
 static
 int
-reapply (void)
+reapply (solver_t * sv)
 {
     int digit, idx, j;
     int allok = 0;
-    memset(board, 0x00, sizeof(board));
-    for (j = 0; j < idx_history; ++j) {
-        if (!(history[j] & IGNORED) && 0 != GET_DIGIT(history[j])) {
-            idx = GET_INDEX(history[j]);
-            digit = GET_DIGIT(history[j]);
-            if (!IS_EMPTY(idx) || DISALLOWED(idx, digit)) {
+    memset(sv->board, 0x00, sizeof(sv->board));
+    memset(sv->used, 0x00, sizeof(sv->used));
+    sv->hash = houses_key(sv->houses);
+    sv->depth = 0;
+    sv->dlx.state = DLX_IDLE;
+    memset(sv->dep, 0x00, sizeof(sv->dep));
+    memset(sv->nogood, 0x00, sizeof(sv->nogood));
+    sv->idx_nogood = 0;
+    for (j = 0; j < sv->idx_history; ++j) {
+        if (!(sv->history[j] & IGNORED) && 0 != GET_DIGIT(sv->history[j])) {
+            idx = GET_INDEX(sv->history[j]);
+            digit = GET_DIGIT(sv->history[j]);
+            if (!IS_EMPTY(sv, idx) || DISALLOWED(sv, idx, digit)) {
                 allok = -1;
             }
-            board[idx] = SET_DIGIT(digit);
-            if (history[j] & FIXED) {
-                board[idx] |= FIXED;
+            sv->hash ^= zobrist[idx][DIGIT(sv, idx)];
+            sv->board[idx] = SET_DIGIT(digit);
+            if (sv->history[j] & FIXED) {
+                sv->board[idx] |= FIXED;
             }
-            update(idx);
+            update(sv, idx);
         }
     }
     return allok;
@@ -888,41 +1312,64 @@ reapply (void)
  */
 static
 void
-clear_moves (void)
+clear_moves (solver_t * sv)
 {
-    for (idx_history = 0; history[idx_history] & FIXED; ++idx_history) {
+    for (sv->idx_history = 0;
+         sv->history[sv->idx_history] & FIXED;
+         ++sv->idx_history) {
        ;
     }
-    reapply();
+    reapply(sv);
 }
 
-static int digits[9];  /* # digits expressed in element square */
-static int counts[9];  /* Counts of the allowed positions indexed by digit-1 */
-
 /* Count # set bits (within STATE_MASK) */
 static
 int
 numset (int mask)
 {
-    int i, n = 0;
-    for (i = STATE_SHIFT + 1; i <= STATE_SHIFT + 9; ++i) {
-        if (mask & (1<<i)) {
-            ++n;
-        } else {
-            ++counts[i - STATE_SHIFT - 1];
+#if defined (__GNUC__)
+    return __builtin_popcount(mask & STATE_MASK);
+#else
+    unsigned int n = (mask & STATE_MASK) >> (STATE_SHIFT + 1);
+    n = n - ((n >> 1) & 0x55555555);
+    n = (n & 0x33333333) + ((n >> 2) & 0x33333333);
+    n = (n + (n >> 4)) & 0x0f0f0f0f;
+    return (int)((n + (n >> 8)) & 0xff);
+#endif
+}
+
+/* Count the masked digits of each square in the unit, and summarise
+ * the allowed positions of each digit without counting them: a digit
+ * seen once is recorded in 'once', and seen again in 'twice', so that
+ * (once & ~twice) are the digits with a single allowed position.
+ */
+static INLINE
+void
+count_kind (solver_t * sv, int kind, int unit)
+{
+    int i, idx, allowed;
+    sv->once = sv->twice = sv->present = 0;
+    for (i = 0; i < 9; ++i) {
+        idx = UNIT_CELL(kind, unit, i);
+        allowed = STATE_MASK & ~STATE(sv, idx);
+        sv->digits[i] = 9 - numset(allowed);
+        sv->twice |= sv->once & allowed;
+        sv->once |= allowed;
+        if (!IS_EMPTY(sv, idx)) {
+            sv->present |= DIGIT_STATE(DIGIT(sv, idx));
         }
     }
-    return n;
 }
 
 static
 void
-count_set_digits (int el, int (*idx_fn)(int, int))
+count_set_digits (solver_t * sv, int unit)
 {
-    int i;
-    memset(counts, 0x00, sizeof(counts));
-    for (i = 0; i < 9; ++i) {
-        digits[i] = numset(board[(*idx_fn)(el, i)]);
+    switch (UNIT_KIND(unit)) {
+    case KIND_ROW:      count_kind(sv, KIND_ROW, unit);      break;
+    case KIND_COLUMN:   count_kind(sv, KIND_COLUMN, unit);   break;
+    case KIND_BLOCK:    count_kind(sv, KIND_BLOCK, unit);    break;
+    default:            count_kind(sv, KIND_HOUSE, unit);    break;
     }
 }
 
@@ -931,20 +1378,20 @@ count_set_digits (int el, int (*idx_fn)(int, int))
  */
 static
 int
-fill (int idx, int digit)
+fill (solver_t * sv, int idx, int digit)
 {
     assert(0 != digit);
 
-    if (!IS_EMPTY(idx)) {
-        return (DIGIT(idx) == digit) ? 0 : -1;
+    if (!IS_EMPTY(sv, idx)) {
+        return (DIGIT(sv, idx) == digit) ? 0 : -1;
     }
-    if (DISALLOWED(idx, digit)) {
+    if (DISALLOWED(sv, idx, digit)) {
         return -1;
     }
 
-    board[idx] = SET_DIGIT(digit);
-    update(idx);
-    add_move(idx, digit, 0);
+    sv->board[idx] = SET_DIGIT(digit);
+    update(sv, idx);
+    append_move(sv, idx, digit, 0);
 
     return 0;
 }
@@ -954,26 +1401,26 @@ fill (int idx, int digit)
  */
 static
 void
-fillx(int idx, int digit)
+fillx (solver_t * sv, int idx, int digit)
 {
     /* Nothing to do if digit already set or cleared */
-    if (DIGIT(idx) == digit) {
+    if (DIGIT(sv, idx) == digit) {
         return;
     }
-    if (0 != digit && IS_EMPTY(idx)) {
-        board[idx] = SET_DIGIT(digit) | SET_INDEX(idx);
-        update(idx);
-        add_move(idx, digit, 0);
+    if (0 != digit && IS_EMPTY(sv, idx)) {
+        sv->board[idx] = SET_DIGIT(digit) | SET_INDEX(idx);
+        update(sv, idx);
+        add_move(sv, idx, digit, 0);
     } else {
         /* Clearing or overwriting is more time consuming */
-        add_move(idx, 0, 0);
-        reapply();
+        add_move(sv, idx, 0, 0);
+        reapply(sv);
 
         /* Always apply moves - even in invalid */
         if (0 != digit) {
-            if (idx_history > 0) {
-                history[idx_history - 1] |= SET_DIGIT(digit);
-                reapply();
+            if (sv->idx_history > 0) {
+                sv->history[sv->idx_history - 1] |= SET_DIGIT(digit);
+                reapply(sv);
             } else {
                 beep();
             }
@@ -986,41 +1433,31 @@ fillx(int idx, int digit)
  * are all squares forbidden while there is no such digit placed yet
  * Return -1 on contradiction, and 0 otherwise.
  */
-static
+static INLINE
 int
-singles (int el, int (*idx_fn)(int, int), int hintcode)
+singles_kind (solver_t * sv, int kind, int unit, int hintcode)
 {
-    int i;
+    int i, unique;
+
+    count_kind(sv, kind, unit);
 
-    count_set_digits(el, idx_fn);
+    /* No allowed position left for a digit not yet in the element */
+    if (STATE_MASK != (STATE_MASK & (sv->once | sv->present))) {
+        return -1;
+    }
+    unique = sv->once & ~sv->twice;
 
     for (i = 0; i < 9; ++i) {
         int c = i;
-        if (0 == counts[c]) {
-            /* No allowed position left for digit 'c+1' in the element. */
-            int nd = 0;
-            int j;
-            for (j = 0; j < 9; ++j) {
-                if (DIGIT((*idx_fn)(el, j)) == c + 1) {
-                    /* The element already contains this digit */
-                    ++nd;
-                    break;
-                }
-            }
-            if (nd == 0) {
-                /* Contradiction found, this element can't have this  digit. */
-                break;
-            }
-        }
-        if (1 == counts[c] &&
-            idx_possible < 81) {
+        if (0 != (unique & DIGIT_STATE(c + 1)) &&
+            sv->idx_possible < 81) {
             /* One allowed position left for digit 'c+1' in the element. */
             int j;
             for (j = 0; j < 9; ++j) {
                 /* Let's find the place. */
-                int idx = (*idx_fn)(el, j);
-                if (!DISALLOWED(idx, c + 1)) {
-                    possible[idx_possible++] = SET_INDEX(idx)
+                int idx = UNIT_CELL(kind, unit, j);
+                if (!DISALLOWED(sv, idx, c + 1)) {
+                    sv->possible[sv->idx_possible++] = SET_INDEX(idx)
                                                | SET_DIGIT(c + 1)
                                                | hintcode;
                     /* We have found that single position, safe to break. */
@@ -1028,27 +1465,154 @@ singles (int el, int (*idx_fn)(int, int), int hintcode)
                 }
             }
         }
-        if (8 == digits[i] &&
-            idx_possible < 81) {
+        if (8 == sv->digits[i] &&
+            sv->idx_possible < 81) {
             /* 8 digits are masked at this position - just one remaining */
-            int idx = (*idx_fn)(el, i);
-            int sta = (STATE_MASK & ~STATE(idx));
-            int d = 0;
-            /* Let's find the appropriate digit */
-            for (sta >>= STATE_SHIFT + 1; 0 != sta; sta >>= 1) {
-                ++d;
-            }
-            assert (0 < d && d < 10 && !DISALLOWED(idx, d));
+            int idx = UNIT_CELL(kind, unit, i);
+            int sta = (STATE_MASK & ~STATE(sv, idx));
+            /* The digit is given by the # bits below the single set bit */
+            int d = 1 + numset(sta - 1);
+            assert (0 < d && d < 10 && !DISALLOWED(sv, idx, d));
             if (0 < d && d < 10) {
                 /* It seems to be an appropriate digit */
-                possible[idx_possible++] = SET_INDEX(idx)
+                sv->possible[sv->idx_possible++] = SET_INDEX(idx)
                                             | SET_DIGIT(d)
                                             | hintcode;
             }
         }
     }
-    return -(i < 9);
+    return 0;
+}
+
+static
+int
+singles (solver_t * sv, int unit, int hintcode)
+{
+    switch (UNIT_KIND(unit)) {
+    case KIND_ROW:    return singles_kind(sv, KIND_ROW, unit, hintcode);
+    case KIND_COLUMN: return singles_kind(sv, KIND_COLUMN, unit, hintcode);
+    case KIND_BLOCK:  return singles_kind(sv, KIND_BLOCK, unit, hintcode);
+    default:          return singles_kind(sv, KIND_HOUSE, unit, hintcode);
+    }
+}
+
+#if defined (HAVE_AVX2)
+/* AVX2 version of findmoves(), with identical results.
+ *
+ * The allowed digits of all 81 squares are kept as 16-bit lanes, so a
+ * handful of vector operations flag every square with a single allowed
+ * digit (x != 0 && 0 == (x & (x-1))). For the hidden singles, lane 'u'
+ * of vector 'j' holds the j'th square of unit 'u', so that the 'once'
+ * and 'twice' reductions of count_set_digits() run over all 27 units
+ * at the same time. The moves are then collected in the same order as
+ * singles() would find them.
+ */
+__attribute__((target("avx2")))
+static
+int
+findmoves_avx2 (solver_t * sv)
+{
+    unsigned short allowed[96];
+    unsigned short naked[96];
+    unsigned short lanes[9][32];
+    unsigned short present[32];
+    unsigned short unique[32];
+    unsigned short moves[32];
+    const __m256i mask = _mm256_set1_epi16((short)STATE_MASK);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    __m256i once[2], twice[2], single[2], v;
+    int el, i, j, k, u, idx, bit, hintcode;
+
+    for (i = 0; i < 81; ++i) {
+        allowed[i] = (unsigned short)(STATE_MASK & ~STATE(sv, i));
+    }
+    for (; i < 96; ++i) {
+        allowed[i] = 0;
+    }
+    /* Naked singles over the whole grid */
+    for (i = 0; i < 96; i += 16) {
+        v = _mm256_loadu_si256((const __m256i *)&allowed[i]);
+        v = _mm256_andnot_si256(_mm256_cmpeq_epi16(v, zero),
+                    _mm256_cmpeq_epi16(_mm256_and_si256(v,
+                                            _mm256_sub_epi16(v, one)),
+                                       zero));
+        _mm256_storeu_si256((__m256i *)&naked[i], v);
+    }
+    /* Hidden singles, and contradictions, unit by unit */
+    for (u = 0; u < 27; ++u) {
+        for (j = 0; j < 9; ++j) {
+            lanes[j][u] = allowed[unit_cell[u][j]];
+        }
+        present[u] = (unsigned short)sv->used[u];
+    }
+    for (; u < 32; ++u) {
+        for (j = 0; j < 9; ++j) {
+            lanes[j][u] = 0;
+        }
+        present[u] = (unsigned short)STATE_MASK;
+    }
+    /* .. noting the units with a naked single too, so that the units
+     * without a move are skipped below
+     */
+    once[0] = once[1] = twice[0] = twice[1] = single[0] = single[1] = zero;
+    for (j = 0; j < 9; ++j) {
+        for (k = 0; k < 2; ++k) {
+            v = _mm256_loadu_si256((const __m256i *)&lanes[j][16 * k]);
+            twice[k] = _mm256_or_si256(twice[k],
+                                       _mm256_and_si256(once[k], v));
+            once[k] = _mm256_or_si256(once[k], v);
+            single[k] = _mm256_or_si256(single[k],
+                    _mm256_andnot_si256(_mm256_cmpeq_epi16(v, zero),
+                        _mm256_cmpeq_epi16(_mm256_and_si256(v,
+                                               _mm256_sub_epi16(v, one)),
+                                           zero)));
+        }
+    }
+    for (k = 0; k < 2; ++k) {
+        v = _mm256_loadu_si256((const __m256i *)&present[16 * k]);
+        v = _mm256_andnot_si256(_mm256_or_si256(once[k], v), mask);
+        if (!_mm256_testz_si256(v, v)) {
+            return -1;
+        }
+        v = _mm256_andnot_si256(twice[k], once[k]);
+        _mm256_storeu_si256((__m256i *)&unique[16 * k], v);
+        _mm256_storeu_si256((__m256i *)&moves[16 * k],
+                            _mm256_or_si256(v, single[k]));
+    }
+
+    sv->idx_possible = 0;
+    for (el = 0; el < 9; ++el) {
+        for (k = 0; k < 3; ++k) {
+            u = 9 * k + el;
+            if (0 == moves[u]) {
+                continue;
+            }
+            hintcode = 0 == k ? HINT_ROW : 1 == k ? HINT_COLUMN : HINT_BLOCK;
+            for (i = 0; i < 9; ++i) {
+                bit = DIGIT_STATE(i + 1);
+                if (0 != (unique[u] & bit) && sv->idx_possible < 81) {
+                    for (j = 0; 0 == (allowed[unit_cell[u][j]] & bit); ++j) {
+                        ;
+                    }
+                    sv->possible[sv->idx_possible++] =
+                                    SET_INDEX(unit_cell[u][j])
+                                    | SET_DIGIT(i + 1)
+                                    | hintcode;
+                }
+                idx = unit_cell[u][i];
+                if (0 != naked[idx] && sv->idx_possible < 81) {
+                    sv->possible[sv->idx_possible++] =
+                                    SET_INDEX(idx)
+                                    | SET_DIGIT(1 + numset(allowed[idx] - 1))
+                                    | hintcode;
+                }
+            }
+        }
+    }
+    return sv->idx_possible;
 }
+#endif
 
 /* Given the board state, find all possible 'moves' (i.e. squares with just
  * a single digit).
@@ -1060,19 +1624,35 @@ singles (int el, int (*idx_fn)(int, int), int hintcode)
  */
 static
 int
-findmoves (void)
+findmoves (solver_t * sv)
 {
-    int el;
+    int el, unit;
 
-    idx_possible = 0;
-    for (el = 0; el < 9; ++el) {
-        if (-1 == singles(el, idx_row, HINT_ROW)        ||
-            -1 == singles(el, idx_column, HINT_COLUMN)  ||
-            -1 == singles(el, idx_block, HINT_BLOCK)) {
+#if defined (HAVE_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        if (-1 == findmoves_avx2(sv)) {
             return -1;
         }
+    } else
+#endif
+    {
+        sv->idx_possible = 0;
+        for (el = 0; el < 9; ++el) {
+            if (-1 == singles(sv, el, HINT_ROW)             ||
+                -1 == singles(sv, 9 + el, HINT_COLUMN)      ||
+                -1 == singles(sv, 18 + el, HINT_BLOCK)) {
+                return -1;
+            }
+        }
     }
-    return idx_possible;
+    /* The houses of a variant, after the classic units */
+    for (unit = 27; 0 != sv->houses && unit < MAX_UNITS; ++unit) {
+        if (0 != (sv->houses & HOUSE_BIT(unit))
+            && -1 == singles(sv, unit, 0)) {
+            return -1;
+        }
+    }
+    return sv->idx_possible;
 }
 
 /* Strategies for refining the board state
@@ -1090,58 +1670,90 @@ findmoves (void)
  *  - 'position2' if the positions of 2 unknown digits in a block match
  *                identically in precisely 2 positions, then those 2 positions
  *                can only contain the 2 unknown digits.
+ *  - 'fish'      if the possible positions of a digit in N rows all lie
+ *                in the same N columns (X-Wing for N=2, Swordfish for 3,
+ *                Jellyfish for 4), then that digit cannot appear elsewhere
+ *                in those columns; likewise with rows and columns swapped.
+ *  - 'subsets'   if N unfilled squares in a row/column/block can only hold
+ *                the same N digits (naked), then no other square there can
+ *                hold them; if N digits can only go in the same N squares
+ *                (hidden), then those squares cannot hold any other digit.
+ *                Generalises 'pairs' and 'position2' to N=2..4.
  *
  * Recall that each state bit uses a 1 to prevent a digit from
  * filling that square.
  */
 
-static
+static INLINE
 void
-pairs (int el, int (*idx_fn)(int, int))
+pairs_kind (solver_t * sv, int kind, int unit)
 {
     int i, j, k, mask, idx;
     for (i = 0; i < 8; ++i) {
-        if (7 == digits[i]) { /* 2 digits unknown */
+        if (7 == sv->digits[i]) { /* 2 digits unknown */
             for (j = i + 1; j < 9; ++j) {
-                idx = (*idx_fn)(el, i);
-                if (STATE(idx) == STATE((*idx_fn)(el, j))) {
+                idx = UNIT_CELL(kind, unit, i);
+                if (STATE(sv, idx) == STATE(sv, UNIT_CELL(kind, unit, j))) {
                     /* Found a row/column pair - mask other entries */
-                    mask = STATE_MASK ^ (STATE_MASK & board[idx]);
+                    mask = STATE_MASK ^ STATE(sv, idx);
                     for (k = 0; k < i; ++k) {
-                        board[(*idx_fn)(el, k)] |= mask;
+                        sv->board[UNIT_CELL(kind, unit, k)] |= mask;
                     }
                     for (k = i + 1; k < j; ++k) {
-                        board[(*idx_fn)(el, k)] |= mask;
+                        sv->board[UNIT_CELL(kind, unit, k)] |= mask;
                     }
                     for (k = j + 1; k < 9; ++k) {
-                        board[(*idx_fn)(el, k)] |= mask;
+                        sv->board[UNIT_CELL(kind, unit, k)] |= mask;
                     }
-                    digits[j] = -1; /* now processed */
+                    sv->digits[j] = -1; /* now processed */
                 }
             }
         }
     }
 }
 
-/* Worker: mask elements outside block */
 static
 void
-exmask (int mask, int block, int el, int (*idx_fn)(int, int))
+pairs (solver_t * sv, int unit)
+{
+    switch (UNIT_KIND(unit)) {
+    case KIND_ROW:      pairs_kind(sv, KIND_ROW, unit);      break;
+    case KIND_COLUMN:   pairs_kind(sv, KIND_COLUMN, unit);   break;
+    case KIND_BLOCK:    pairs_kind(sv, KIND_BLOCK, unit);    break;
+    default:            pairs_kind(sv, KIND_HOUSE, unit);    break;
+    }
+}
+
+/* Worker: mask elements outside block, in a row or column */
+static INLINE
+void
+exmask_kind (solver_t * sv, int kind, int mask, int block, int unit)
 {
     int i, idx;
 
     for (i = 0; i < 9; ++i) {
-        idx = (*idx_fn)(el, i);
-        if (block != BLOCK(idx) && IS_EMPTY(idx)) {
-            board[idx] |= mask;
+        idx = UNIT_CELL(kind, unit, i);
+        if (18 + block != BLOCK_UNIT(idx) && IS_EMPTY(sv, idx)) {
+            sv->board[idx] |= mask;
         }
     }
 }
 
+static
+void
+exmask (solver_t * sv, int mask, int block, int unit)
+{
+    if (KIND_ROW == UNIT_KIND(unit)) {
+        exmask_kind(sv, KIND_ROW, mask, block, unit);
+    } else {
+        exmask_kind(sv, KIND_COLUMN, mask, block, unit);
+    }
+}
+
 /* Worker for block() */
 static
 void
-exblock (int block, int el, int (*idx_fn)(int, int))
+exblock (solver_t * sv, int block, int unit)
 {
     int i, idx, mask;
 
@@ -1152,121 +1764,120 @@ exblock (int block, int el, int (*idx_fn)(int, int))
      */
     mask = 0;
     for (i = 0; i < 9; ++i) {
-        idx = idx_block(block, i);
-        if (!IS_EMPTY(idx)) {
-            mask |= DIGIT_STATE(DIGIT(idx));
+        idx = UNIT_CELL(KIND_BLOCK, 18 + block, i);
+        if (!IS_EMPTY(sv, idx)) {
+            mask |= DIGIT_STATE(DIGIT(sv, idx));
         }
     }
-    exmask(mask ^ STATE_MASK, block, el, idx_fn);
+    exmask(sv, mask ^ STATE_MASK, block, unit);
 }
 
 static
 void
-block (int el)
+block (solver_t * sv, int el)
 {
     int i, idx, row, col;
 
     /* Find first unknown square */
-    for (i = 0; i < 9 && !IS_EMPTY(idx = idx_block(el, i)); ++i) {
+    for (i = 0; i < 9 && !IS_EMPTY(sv, idx = unit_cell[18 + el][i]); ++i) {
        ;
     }
     if (i < 9) {
-        assert(IS_EMPTY(idx));
-        row = ROW(idx);
-        col = COLUMN(idx);
+        assert(IS_EMPTY(sv, idx));
+        row = ROW_UNIT(idx);
+        col = COLUMN_UNIT(idx);
         for (++i; i < 9; ++i) {
-            idx = idx_block(el, i);
-            if (IS_EMPTY(idx)) {
-                if (ROW(idx) != row) {
+            idx = unit_cell[18 + el][i];
+            if (IS_EMPTY(sv, idx)) {
+                if (ROW_UNIT(idx) != row) {
                     row = -1;
                 }
-                if (COLUMN(idx) != col) {
+                if (COLUMN_UNIT(idx) != col) {
                     col = -1;
                 }
             }
         }
         if (0 <= row) {
-            exblock(el, row, idx_row);
+            exblock(sv, el, row);
         }
         if (0 <= col) {
-            exblock(el, col, idx_column);
+            exblock(sv, el, col);
         }
     }
 }
 
 static
 void
-common (int el)
+common (solver_t * sv, int el)
 {
     int i, idx, row, col, digit, mask;
 
     for (digit = 1; digit <= 9; ++digit) {
         mask = DIGIT_STATE(digit);
-        row = col = -1;  /* Value '9' indicates invalid */
+        row = col = -1;  /* Value '27' indicates invalid */
         for (i = 0; i < 9; ++i) {
             /* Digit possible? */
-            idx = idx_block(el, i);
-            if (IS_EMPTY(idx) && 0 == (board[idx] & mask)) {
+            idx = unit_cell[18 + el][i];
+            if (IS_EMPTY(sv, idx) && 0 == (STATE(sv, idx) & mask)) {
                 if (row < 0) {
-                    row = ROW(idx);
-                } else if (row != ROW(idx)) {
-                    row = 9; /* Digit appears in multiple rows */
+                    row = ROW_UNIT(idx);
+                } else if (row != ROW_UNIT(idx)) {
+                    row = 27; /* Digit appears in multiple rows */
                 }
                 if (col < 0) {
-                    col = COLUMN(idx);
-                } else if (col != COLUMN(idx)) {
-                    col = 9; /* Digit appears in multiple columns */
+                    col = COLUMN_UNIT(idx);
+                } else if (col != COLUMN_UNIT(idx)) {
+                    col = 27; /* Digit appears in multiple columns */
                 }
             }
         }
-        if (-1 != row && row < 9) {
-            exmask(mask, el, row, idx_row);
+        if (-1 != row && row < 27) {
+            exmask(sv, mask, el, row);
         }
-        if (-1 != col && col < 9) {
-            exmask(mask, el, col, idx_column);
+        if (-1 != col && col < 27) {
+            exmask(sv, mask, el, col);
         }
     }
 }
 
-/* Encoding of positions of a digit (c.f. position2()) - abuse DIGIT_STATE */
-static int posn_digit[10];
-
+/* Encoding of positions of a digit uses posn_digit - abuse DIGIT_STATE */
 static
 void
-position2 (int el)
+position2 (solver_t * sv, int el)
 {
     int digit, digit2, i, mask, mask2, posn, count, idx;
 
     /* Calculate positions of each digit within block */
     for (digit = 1; digit <= 9; ++digit) {
         mask = DIGIT_STATE(digit);
-        posn_digit[digit] = count = posn = 0;
+        sv->posn_digit[digit] = count = posn = 0;
         for (i = 0; i < 9; ++i) {
-            if (0 == (mask & board[idx_block(el, i)])) {
+            if (0 == (mask & STATE(sv, unit_cell[18 + el][i]))) {
                 ++count;
                 posn |= DIGIT_STATE(i);
             }
         }
         if (2 == count) {
-            posn_digit[digit] = posn;
+            sv->posn_digit[digit] = posn;
         }
     }
     /* Find pairs of matching positions, and mask */
     for (digit = 1; digit < 9; ++digit) {
-        if (0 != posn_digit[digit]) {
+        if (0 != sv->posn_digit[digit]) {
             for (digit2 = digit + 1; digit2 <= 9; ++digit2) {
-                if (posn_digit[digit] == posn_digit[digit2]) {
+                if (sv->posn_digit[digit] == sv->posn_digit[digit2]) {
                     mask = STATE_MASK
                            ^ (DIGIT_STATE(digit) | DIGIT_STATE(digit2));
                     mask2 = DIGIT_STATE(digit);
                     for (i = 0; i < 9; ++i) {
-                        idx = idx_block(el, i);
-                        if (0 == (mask2 & board[idx])) {
-                            assert(0 == (DIGIT_STATE(digit2) & board[idx]));
-                            board[idx] |= mask;
+                        idx = unit_cell[18 + el][i];
+                        if (0 == (mask2 & STATE(sv, idx))) {
+                            assert(0 == (DIGIT_STATE(digit2)
+                                         & STATE(sv, idx)));
+                            sv->board[idx] |= mask;
                         }
                     }
-                    posn_digit[digit] = posn_digit[digit2] = 0;
+                    sv->posn_digit[digit] = sv->posn_digit[digit2] = 0;
                     break;
                 }
             }
@@ -1274,2125 +1885,5194 @@ position2 (int el)
     }
 }
 
-/* Find some moves for the board; starts with a simple approach (finding
- * singles), and if no moves found, starts using more involved strategies
- * until a move is found. The more advanced strategies can mask states
- * in the board, making this an efficient mechanism, but difficult for
- * a human to understand.
+/* Worker for fish(): extend the set of base lines (rows, or columns if
+ * 'by_column') from line 'start' onwards. 'posn' gives the possible
+ * positions of the digit along each base line (abusing DIGIT_STATE, as
+ * for posn_digit), 'lines' the base lines chosen so far and 'cover' the
+ * union of their positions. Returns the # eliminations made.
  */
 static
 int
-allmoves (void)
+fish_lines (solver_t * sv, const int * posn, int by_column, int digit,
+            int size, int start, int count, int lines, int cover)
 {
-    int i, n;
-
-    n = findmoves();
-    if (0 != n) {
-        return n;
-    }
-
-    for (i = 0; i < 9; ++i) {
-        count_set_digits(i, idx_row);
-        pairs(i, idx_row);
+    int i, j, idx, mask, n = 0;
 
-        count_set_digits(i, idx_column);
-        pairs(i, idx_column);
-
-        count_set_digits(i, idx_block);
-        pairs(i, idx_block);
-    }
-    n = findmoves();
-    if (0 != n) {
+    if (count == size) {
+        /* Digit is confined to the cover lines within the base lines */
+        mask = DIGIT_STATE(digit);
+        for (i = 0; i < 9; ++i) {
+            if (0 != (lines & (1 << i)) || 0 == (posn[i] & cover)) {
+                continue;
+            }
+            for (j = 0; j < 9; ++j) {
+                if (0 != (posn[i] & cover & DIGIT_STATE(j + 1))) {
+                    idx = by_column ? INDEX(j, i) : INDEX(i, j);
+                    if (0 == (sv->board[idx] & mask)) {
+                        sv->board[idx] |= mask;
+                        ++n;
+                    }
+                }
+            }
+        }
         return n;
     }
-    for (i = 0; i < 9; ++i) {
-        block(i);
-        common(i);
-        position2(i);
+    for (i = start; i <= 9 - (size - count); ++i) {
+        /* A line with a single position is left to singles() */
+        if (1 < numset(posn[i]) && numset(cover | posn[i]) <= size) {
+            n += fish_lines(sv, posn, by_column, digit, size, i + 1,
+                            count + 1, lines | (1 << i), cover | posn[i]);
+        }
     }
-    return findmoves();
-}
-
-/* Helper: sort based on index */
-static
-int
-cmpindex (const void * a, const void * b)
-{
-    return GET_INDEX(*((const int *)b)) - GET_INDEX(*((const int *)a));
+    return n;
 }
 
-/* Return number of hints. The hints mechanism should attempt to find
- * 'easy' moves first, and if none are possible, then try for more
- * cryptic moves.
+/* Worker for subsets(): extend the set of chosen entries from entry
+ * 'start' onwards. For naked subsets the entries are the squares of
+ * the unit and 'mask' their allowed digits; for hidden subsets the
+ * entries are digits and 'mask' their positions in the unit. Entry i
+ * is recorded in 'chosen' as DIGIT_STATE(i + 1), and 'uni' is the union
+ * of the chosen masks. Returns the # squares masked.
  */
+static
 int
-findhints (void)
+subset_entries (solver_t * sv, const unsigned char * cell, const int * mask,
+                int hidden, int size, int start, int count, int chosen,
+                int uni)
 {
-    int i, n, mutated = 0;
+    int i, idx, n = 0;
 
-    n = findmoves();
-    if (n < 2) {
-        /* Each call to pairs() can mutate the board state, making the
-         * hints very, very cryptic... so later undo the mutations.
-         */
+    if (count == size) {
         for (i = 0; i < 9; ++i) {
-            count_set_digits(i, idx_row);
-            pairs(i, idx_row);
-
-            count_set_digits(i, idx_column);
-            pairs(i, idx_column);
-
-            count_set_digits(i, idx_block);
-            pairs(i, idx_block);
+            if (hidden) {
+                /* Squares holding the digits can hold nothing else */
+                idx = cell[i];
+                if (0 != (uni & DIGIT_STATE(i + 1))
+                    && 0 != (STATE_MASK & ~STATE(sv, idx) & ~chosen)) {
+                    sv->board[idx] |= STATE_MASK ^ chosen;
+                    ++n;
+                }
+            } else if (0 == (chosen & DIGIT_STATE(i + 1))
+                       && 0 != (mask[i] & uni)) {
+                /* Other squares cannot hold the digits */
+                idx = cell[i];
+                if (0 != (uni & ~STATE(sv, idx))) {
+                    sv->board[idx] |= uni;
+                    ++n;
+                }
+            }
         }
-        mutated = 1;
-        n = findmoves();
+        return n;
     }
-    if (n < 2) {
-        for (i = 0; i < 9; ++i) {
-            block(i);
-            common(i);
+    for (i = start; i <= 9 - (size - count); ++i) {
+        if (1 < numset(mask[i]) && numset(uni | mask[i]) <= size) {
+            n += subset_entries(sv, cell, mask, hidden, size, i + 1,
+                                count + 1, chosen | DIGIT_STATE(i + 1),
+                                uni | mask[i]);
         }
-        mutated = 1;
-        n = findmoves();
     }
+    return n;
+}
 
-    /* Sort the possible moves, and allow just one hint per square */
-    if (0 < n) {
-        int i, j;
+static
+int
+subsets (solver_t * sv, int unit)
+{
+    const unsigned char * cell = unit_cell[unit];
+    int i, idx, size, allowed, digit, unknown = 0, n = 0;
+    int squares[9], posns[9];
 
-        qsort(possible, n, sizeof(int), cmpindex);
-        for (i = 0, j = 1; j < n; ++j) {
-            if (GET_INDEX(possible[i]) == GET_INDEX(possible[j])) {
-                /* Let the user make mistakes - do not assume the
-                 * board is in a consistent state.
-                 */
-                if (GET_DIGIT(possible[i]) == GET_DIGIT(possible[j])) {
-                    possible[i] |= possible[j];
-                }
-            } else {
-                i = j;
+    memset(posns, 0x00, sizeof(posns));
+    for (i = 0; i < 9; ++i) {
+        idx = cell[i];
+        squares[i] = 0;
+        if (IS_EMPTY(sv, idx)) {
+            squares[i] = allowed = STATE_MASK & ~STATE(sv, idx);
+            ++unknown;
+            for (; 0 != allowed; allowed &= allowed - 1) {
+                digit = numset((allowed & -allowed) - 1);
+                posns[digit] |= DIGIT_STATE(i + 1);
             }
         }
-        n = i + 1;
     }
-
-    /* Undo any mutations of the board state */
-    if (mutated) {
-        reapply();
+    /* A subset of N squares leaves a hidden subset of the others */
+    for (size = 2; size <= 4 && 2 * size <= unknown; ++size) {
+        n += subset_entries(sv, cell, squares, 0, size, 0, 0, 0, 0);
+        n += subset_entries(sv, cell, posns, 1, size, 0, 0, 0, 0);
     }
     return n;
 }
 
-/* Deterministic solver; return 0 on success, else -1 on error.
+/* Try fish of increasing size, stopping at the first size that masks
+ * any square. Returns the # eliminations made.
  */
 static
 int
-deterministic (void)
+fish (solver_t * sv)
 {
-    int i, n;
+    int digit, row, col, idx, allowed, size, n = 0;
+    int rows[9][9], cols[9][9];
 
-    n = allmoves();
-    while (0 < n) {
-        ++pass;
-        for (i = 0; i < n; ++i) {
-            if (-1 == fill(GET_INDEX(possible[i]),
-                            GET_DIGIT(possible[i]))) {
-                return -1;
+    memset(rows, 0x00, sizeof(rows));
+    memset(cols, 0x00, sizeof(cols));
+    for (row = 0; row < 9; ++row) {
+        for (col = 0; col < 9; ++col) {
+            idx = INDEX(row, col);
+            if (!IS_EMPTY(sv, idx)) {
+                continue;
             }
+            allowed = STATE_MASK & ~STATE(sv, idx);
+            for (; 0 != allowed; allowed &= allowed - 1) {
+                /* The digit is given by the # bits below the lowest bit */
+                digit = numset((allowed & -allowed) - 1);
+                rows[digit][row] |= DIGIT_STATE(col + 1);
+                cols[digit][col] |= DIGIT_STATE(row + 1);
+            }
+        }
+    }
+    for (size = 2; 0 == n && size <= 4; ++size) {
+        for (digit = 1; digit <= 9; ++digit) {
+            n += fish_lines(sv, rows[digit - 1], 0, digit, size, 0, 0, 0, 0);
+            n += fish_lines(sv, cols[digit - 1], 1, digit, size, 0, 0, 0, 0);
         }
-        n = allmoves();
     }
     return n;
 }
 
-/* Return index of square for choice.
- *
- * If no choice is possible (i.e. board solved or inconsistent),
- * return -1.
- *
- * The current implementation finds a square with the minimum
- * number of unknown digits (i.e. maximum # masked digits).
+/* Given the 'n' moves just found by findmoves(), use more involved
+ * strategies while there are none, until a move is found (c.f.
+ * allmoves()).
+ */
+static
+int
+refine (solver_t * sv, int n)
+{
+    int i;
+
+    /* Squares masked by the other strategies carry no reasons to blame
+     * (c.f. explain()), so backjumping relies on singles alone.
+     */
+    if (0 != (sv->strategies & STRATEGY_BACKJUMP)) {
+        return n;
+    }
+    while (0 == n) {
+        if (0 != (sv->strategies & STRATEGY_SUBSETS)) {
+            for (i = 0; i < MAX_UNITS; ++i) {
+                if (i < 27 || 0 != (sv->houses & HOUSE_BIT(i))) {
+                    subsets(sv, i);
+                }
+            }
+        } else {
+            for (i = 0; i < 9; ++i) {
+                count_set_digits(sv, i);
+                pairs(sv, i);
+
+                count_set_digits(sv, 9 + i);
+                pairs(sv, 9 + i);
+
+                count_set_digits(sv, 18 + i);
+                pairs(sv, 18 + i);
+            }
+            for (i = 27; 0 != sv->houses && i < MAX_UNITS; ++i) {
+                if (0 != (sv->houses & HOUSE_BIT(i))) {
+                    count_set_digits(sv, i);
+                    pairs(sv, i);
+                }
+            }
+        }
+        n = findmoves(sv);
+        if (0 != n) {
+            break;
+        }
+        for (i = 0; i < 9; ++i) {
+            block(sv, i);
+            common(sv, i);
+            if (0 == (sv->strategies & STRATEGY_SUBSETS)) {
+                position2(sv, i);
+            }
+        }
+        n = findmoves(sv);
+
+        /* Fish mask squares for the classic strategies to build on */
+        if (0 != n || 0 == (sv->strategies & STRATEGY_FISH)
+            || 0 == fish(sv)) {
+            break;
+        }
+        n = findmoves(sv);
+    }
+    return n;
+}
+
+/* Find some moves for the board; starts with a simple approach (finding
+ * singles), and if no moves found, starts using more involved strategies
+ * until a move is found. The more advanced strategies can mask states
+ * in the board, making this an efficient mechanism, but difficult for
+ * a human to understand.
  */
 static
 int
-cmp (const void * e1, const void * e2)
+allmoves (solver_t * sv)
 {
-    return GET_DIGIT(*(const int *)e2) - GET_DIGIT(*(const int *)e1);
+    return refine(sv, findmoves(sv));
 }
 
+/* Helper: sort based on index */
 static
 int
-choice (void)
+cmpindex (const void * a, const void * b)
+{
+    return GET_INDEX(*((const int *)b)) - GET_INDEX(*((const int *)a));
+}
+
+/* Return number of hints. The hints mechanism should attempt to find
+ * 'easy' moves first, and if none are possible, then try for more
+ * cryptic moves.
+ */
+int
+findhints (solver_t * sv)
 {
-    int i, n;
-    for (n = i = 0; i < 81; ++i) {
-        if (IS_EMPTY(i)) {
-            possible[n] = SET_INDEX(i) | SET_DIGIT(numset(board[i]));
+    int i, n, mutated = 0;
 
-            /* Inconsistency if square unknown, but nothing possible */
-            if (9 == GET_DIGIT(possible[n]))
-                return -2;
-            ++n;
+    n = findmoves(sv);
+    if (n < 2) {
+        /* Each call to pairs() can mutate the board state, making the
+         * hints very, very cryptic... so later undo the mutations.
+         */
+        for (i = 0; i < 9; ++i) {
+            count_set_digits(sv, i);
+            pairs(sv, i);
+
+            count_set_digits(sv, 9 + i);
+            pairs(sv, 9 + i);
+
+            count_set_digits(sv, 18 + i);
+            pairs(sv, 18 + i);
         }
+        mutated = 1;
+        n = findmoves(sv);
     }
-    if (0 == n) {
-        return -1;      /* All squares known */
+    if (n < 2) {
+        for (i = 0; i < 9; ++i) {
+            block(sv, i);
+            common(sv, i);
+        }
+        mutated = 1;
+        n = findmoves(sv);
+    }
+
+    /* Sort the possible moves, and allow just one hint per square */
+    if (0 < n) {
+        int i, j;
+
+        qsort(sv->possible, n, sizeof(int), cmpindex);
+        for (i = 0, j = 1; j < n; ++j) {
+            if (GET_INDEX(sv->possible[i]) == GET_INDEX(sv->possible[j])) {
+                /* Let the user make mistakes - do not assume the
+                 * board is in a consistent state.
+                 */
+                if (GET_DIGIT(sv->possible[i]) == GET_DIGIT(sv->possible[j])) {
+                    sv->possible[i] |= sv->possible[j];
+                }
+            } else {
+                i = j;
+            }
+        }
+        n = i + 1;
+    }
+
+    /* Undo any mutations of the board state */
+    if (mutated) {
+        reapply(sv);
     }
-    qsort(possible, n, sizeof(possible[0]), cmp);
-    return GET_INDEX(possible[0]);
+    return n;
 }
 
-/* Choose a digit for the given square.
- * The starting digit is passed as a parameter.
- * Returns -1 if no choice possible.
- */
+/* Operations on sets of choice levels */
 static
-int
-choose (int idx, int digit)
+void
+levels_add (levels_t * set, int level)
 {
-    for (; digit <= 9; ++digit) {
-        if (!DISALLOWED(idx, digit)) {
-            board[idx] = SET_DIGIT(digit);
-            update(idx);
-            add_move(idx, digit, CHOICE);
-            return digit;
-        }
+    set->w[level >> 5] |= 1u << (level & 31);
+}
+
+static
+void
+levels_merge (levels_t * set, const levels_t * other)
+{
+    set->w[0] |= other->w[0];
+    set->w[1] |= other->w[1];
+    set->w[2] |= other->w[2];
+}
+
+/* All levels 1..level */
+static
+void
+levels_upto (levels_t * set, int level)
+{
+    int i;
+    memset(set, 0x00, sizeof(*set));
+    for (i = 1; i <= level; ++i) {
+        levels_add(set, i);
     }
-    return -1;
 }
 
-/* Backtrack to a previous choice point, and attempt to reseed
- * the search. Return -1 if no further choice possible, or
- * the index of the changed square.
- *
- * Assumes that the move history and board are valid.
+/* Add the choices that stop 'digit' going in square 'idx' to 'set': a
+ * filled square, or a square holding the digit in the same unit (or
+ * house). Returns -1 if the digit was masked by a strategy, so
+ * unexplained.
  */
 static
 int
-backtrack (void)
+excluded_by (solver_t * sv, int idx, int digit, levels_t * set)
 {
-    int digit, idx;
+    int i, k, unit, peer;
 
-    for (; 0 < --idx_history;) {
-        if (history[idx_history] & CHOICE) {
-            /* Remember the last choice, and advance */
-            idx = GET_INDEX(history[idx_history]);
-            digit = GET_DIGIT(history[idx_history]) + 1;
-            reapply();
-            if (-1 != choose(idx, digit)) {
-                return idx;
+    if (!IS_EMPTY(sv, idx)) {
+        levels_merge(set, &sv->dep[idx]);
+        return 0;
+    }
+    for (k = 0; k < 6; ++k) {
+        if (k < 3) {
+            unit = cell_unit[idx][k];
+        } else if (0 == sv->houses) {
+            break;
+        } else if (0 == (unit = cell_house[idx][k - 3])) {
+            break;
+        } else if (0 == (sv->houses & HOUSE_BIT(unit))) {
+            continue;
+        }
+        if (0 != (sv->used[unit] & DIGIT_STATE(digit))) {
+            for (i = 0; i < 9; ++i) {
+                peer = unit_cell[unit][i];
+                if (DIGIT(sv, peer) == digit) {
+                    levels_merge(set, &sv->dep[peer]);
+                    return 0;
+                }
             }
         }
     }
     return -1;
 }
 
-/* Attempt to solve 'board'; return 0 on success else -1 on error.
- *
- * The solution process attempts to fill-in deterministically as
- * much of the board as possible. Once that is no longer possible,
- * need to choose a square to fill in.
+/* Record the choices that force 'digit' into the empty square 'idx',
+ * before it is filled: as a naked single, else a hidden single in one
+ * of its units or houses, else (conservatively) every choice so far.
  */
 static
-int
-solve (void)
+void
+explain (solver_t * sv, int idx, int digit)
 {
-    int idx;
+    levels_t set;
+    int i, k, d, ok;
+
+    memset(&set, 0x00, sizeof(set));
+    for (ok = 1, d = 1; ok && d <= 9; ++d) {
+        ok = d == digit || 0 == excluded_by(sv, idx, d, &set);
+    }
+    for (k = 0; !ok && k < 6; ++k) {
+        const unsigned char * cell;
+        if (k < 3) {
+            cell = unit_cell[cell_unit[idx][k]];
+        } else if (0 == cell_house[idx][k - 3]) {
+            break;
+        } else if (0 == (sv->houses & HOUSE_BIT(cell_house[idx][k - 3]))) {
+            continue;
+        } else {
+            cell = unit_cell[cell_house[idx][k - 3]];
+        }
+        memset(&set, 0x00, sizeof(set));
+        for (ok = 1, i = 0; ok && i < 9; ++i) {
+            ok = cell[i] == idx || 0 == excluded_by(sv, cell[i], digit, &set);
+        }
+    }
+    if (!ok) {
+        levels_upto(&set, sv->depth);
+    }
+    sv->dep[idx] = set;
+}
 
-    for (;;) {
-        if (0 == deterministic()) {
-            /* Solved, make a new choice, or rewind a previous choice */
-            idx = choice();
-            if (-1 == idx) {
-                idx = 0;
-                break;
-            } else if ((idx < 0 || -1 == choose(idx, 1))
-                       && -1 == backtrack()) {
-                idx = -1;
-                break;
+/* findmoves() restricted to what the fills of the previous pass can
+ * have changed: the squares of the units in 'units', and the positions
+ * of the digits in 'digits' (or of any digit in 'units') in every unit.
+ * All the moves found by the previous pass have been filled since, so
+ * there are none elsewhere and this lists the same moves, in the same
+ * order, as findmoves() would.
+ */
+static
+int
+findmoves_dirty (solver_t * sv, const unsigned char * units, int digits)
+{
+    int unique[27];
+    int allowed[81];
+    unsigned char naked[81];
+    int el, i, j, k, u, idx, bit, mask, once, twice, hintcode;
+
+    memset(naked, 0x00, sizeof(naked));
+    for (u = 0; u < 27; ++u) {
+        mask = (units[u] ? STATE_MASK : digits) & ~sv->used[u];
+        unique[u] = 0;
+        if (0 == mask) {
+            continue;
+        }
+        once = twice = 0;
+        for (k = 0; k < 9; ++k) {
+            idx = unit_cell[u][k];
+            allowed[idx] = STATE_MASK & ~STATE(sv, idx);
+            twice |= once & allowed[idx];
+            once |= allowed[idx];
+            if (units[u]) {
+                naked[idx] = 0 != allowed[idx]
+                             && 0 == (allowed[idx] & (allowed[idx] - 1));
             }
-        } else {
-            /* rewind to a previous choice */
-            if (-1 == backtrack()) {
-                idx = -1;
-                break;
+        }
+        if (0 != (mask & ~once)) {
+            /* No allowed position left for a digit not yet placed */
+            return -1;
+        }
+        unique[u] = mask & once & ~twice;
+    }
+
+    sv->idx_possible = 0;
+    for (el = 0; el < 9; ++el) {
+        for (k = 0; k < 3; ++k) {
+            u = 9 * k + el;
+            hintcode = 0 == k ? HINT_ROW : 1 == k ? HINT_COLUMN : HINT_BLOCK;
+            for (i = 0; i < 9; ++i) {
+                bit = DIGIT_STATE(i + 1);
+                if (0 != (unique[u] & bit) && sv->idx_possible < 81) {
+                    for (j = 0; 0 == (allowed[unit_cell[u][j]] & bit); ++j) {
+                        ;
+                    }
+                    sv->possible[sv->idx_possible++] =
+                                    SET_INDEX(unit_cell[u][j])
+                                    | SET_DIGIT(i + 1)
+                                    | hintcode;
+                }
+                idx = unit_cell[u][i];
+                if (naked[idx] && sv->idx_possible < 81) {
+                    sv->possible[sv->idx_possible++] =
+                                    SET_INDEX(idx)
+                                    | SET_DIGIT(1 + numset(allowed[idx] - 1))
+                                    | hintcode;
+                }
             }
         }
     }
-    return idx;
+    return sv->idx_possible;
 }
 
-/* Find all solutions to a given board, and return the number of
- * solutions (0 if none found).
+/* Deterministic solver; return 0 on success, else -1 on error.
+ *
+ * Filling a square only changes the squares in its row, column and
+ * block, so after a pass only those, and the positions of the digits
+ * filled, are looked at again (c.f. findmoves_dirty()). Once that finds
+ * nothing, refine() tries its strategies on the whole board.
  */
 static
 int
-number_solutions (void)
+deterministic (solver_t * sv)
 {
-    int count = 0;
-    if (-1 != solve()) {
-        do {
-            ++count;
-        } while (-1 != backtrack() && -1 != solve());
+    int i, n, digits;
+    unsigned char units[27];
+
+    n = allmoves(sv);
+    while (0 < n) {
+        ++sv->pass;
+        memset(units, 0x00, sizeof(units));
+        digits = 0;
+        for (i = 0; i < n; ++i) {
+            int idx = GET_INDEX(sv->possible[i]);
+            int digit = GET_DIGIT(sv->possible[i]);
+            if (0 != (sv->strategies & STRATEGY_BACKJUMP)
+                && IS_EMPTY(sv, idx)) {
+                explain(sv, idx, digit);
+            }
+            if (-1 == fill(sv, idx, digit)) {
+                return -1;
+            }
+            units[ROW_UNIT(idx)] = 1;
+            units[COLUMN_UNIT(idx)] = 1;
+            units[BLOCK_UNIT(idx)] = 1;
+            digits |= DIGIT_STATE(digit);
+        }
+        /* A full list may have left moves out, and houses mask squares
+         * outside of the units marked
+         */
+        n = 81 == n || 0 != sv->houses ? findmoves(sv)
+                                       : findmoves_dirty(sv, units, digits);
+        n = refine(sv, n);
     }
-    return count;
+    return n;
 }
 
-/* Build/modify internal representation from file
- *
- *  - lines starting with '#' are ignored
- *  - puzzles start with a line beginning with '%' (with optional title)
- *  - two formats are support: compact, verbose
- *  - templates are always compact
- *  - compact boards have no spaces or block separators
- *  - verbose boards have spaces and block separators
+/* Return index of square for choice.
  *
- * When is_tmplt is TRUE, a template is read.
+ * If no choice is possible (i.e. board solved or inconsistent),
+ * return -1 (solved) or -2 (inconsistent).
  *
- * Return 0 on success; else -1 on error
+ * Every policy finds a square with the minimum number of unknown
+ * digits (i.e. maximum # masked digits), the first one found on ties.
+ * bDegree breaks ties on the most unknown squares in the row, column
+ * and block. bDigit instead branches on the positions of a digit in a
+ * unit (branch_unit, branch_digit) if it has fewer positions than the
+ * square has digits, returning the first position.
  */
-
-static char line[80];
-static char title[80];
-
-#define COMPACT  0
-#define VERBOSE  1
-
 static
 int
-read_board (FILE * f, int is_tmplt)
+choice (solver_t * sv)
 {
-    char * p, * q;
-    int i, row, col, type = COMPACT;
-
-    reset();
-    len_tmplt = 0;
-
-    /* Skip lines until a '%' is found */
-    line[0] = ' ';
-    while ('%' != line[0]) {
-        if (0 == tgets(line, sizeof(line), f)) {
-            return -1;
+    int i, j, u, idx, masked, degree, allowed, digit;
+    int most = -1, best = -1, best_degree = -1, fewest;
+    int unknown[27], count[9];
+
+    sv->branch_unit = -1;
+    if (bDegree == sv->branching) {
+        for (u = 0; u < 27; ++u) {
+            unknown[u] = 9 - numset(sv->used[u]);
         }
     }
-    /* Read optional title, and removing trailing whitespace */
-    for (p = line + 1; *p && isspace(*p); ++p) {
-       ;
-    }
-    if (*p) {
-        for (q = title; '\0' != (*q++ = *p++);) {
-           ;
-        }
-        --q;
-        while (isspace(*--q)) {
-           ;
+    for (i = 0; i < 81; ++i) {
+        if (IS_EMPTY(sv, i)) {
+            masked = numset(STATE(sv, i));
+
+            /* Inconsistency if square unknown, but nothing possible */
+            if (9 == masked) {
+                return -2;
+            }
+            if (masked > most) {
+                most = masked;
+                best = i;
+                best_degree = -1;
+            }
+            if (bDegree == sv->branching && masked == most) {
+                degree = unknown[ROW_UNIT(i)] + unknown[COLUMN_UNIT(i)]
+                         + unknown[BLOCK_UNIT(i)];
+                if (degree > best_degree) {
+                    best_degree = degree;
+                    best = i;
+                }
+            }
         }
-        *++q = '\0';
-    } else {
-        strcpy(title, "(untitled)");
     }
-    /* Consume comment lines - no leading spaces allowed */
-    line[0] = '#';
-    while ('#' == line[0]) {
-        if (0 == tgets(line, sizeof(line), f)) {
-            return -1;
-        }
+    if (best < 0) {
+        return -1;      /* All squares known */
     }
-    /* Analyse first line to determine the 'type' - default is COMPACT */
-    if (0 == is_tmplt) {
-        for (p = line; *p && COMPACT == type; ++p) {
-            if ('|' == *p) {
-                type = VERBOSE;
+    if (bDigit == sv->branching
+        && 0 == (sv->strategies & STRATEGY_BACKJUMP)) {
+        fewest = 9 - most;
+        for (u = 0; u < 27; ++u) {
+            memset(count, 0x00, sizeof(count));
+            for (i = 0; i < 9; ++i) {
+                idx = unit_cell[u][i];
+                if (IS_EMPTY(sv, idx)) {
+                    allowed = STATE_MASK & ~STATE(sv, idx);
+                    for (; 0 != allowed; allowed &= allowed - 1) {
+                        ++count[numset((allowed & -allowed) - 1)];
+                    }
+                }
+            }
+            for (j = 0; j < 9; ++j) {
+                if (1 < count[j] && count[j] < fewest) {
+                    fewest = count[j];
+                    sv->branch_unit = u;
+                    sv->branch_digit = j + 1;
+                }
             }
         }
-    }
-    /* Consume grid - allow leading spaces and comments at end */
-    for (row = 0; row < 9; ++row) {
-        /* Assume line already loaded into buffer; skip leading spaces */
-        for (p = line; *p && isspace(*p); ++p) {
-           ;
-        }
-        for (col = 0; *p && col < 9; ++col, ++p) {
-            if (is_tmplt) {
-                if ('*' == *p) {
-                    tmplt[len_tmplt++] = INDEX(row, col);
-                }
-            } else {
-                if (VERBOSE == type) {
-                    while (*p && (isspace(*p) || '|' == *p)) {
-                        ++p;
-                    }
-                }
-                if (isdigit(*p)) {
-                    if (0 != fill(INDEX(row, col), *p - '0')) {
-                        return -1;
-                    }
-                    board[INDEX(row, col)] |= FIXED;
-                }
-                /* else assume blank square */
-            }
-        }
-        /* Don't complain about any trailing characters - ignored silently */
-
-        /* Load next line (if needed) */
-        if (row < 8) {
-            if (0 == tgets(line, sizeof(line), f)) {
-                return -1;
-            }
-            if (VERBOSE == type
-                && 2 == row % 3
-                && 0 == tgets(line, sizeof(line), f)) {
-                return -1; /* Skip separators */
-            }
-        }
-    }
-
-    /* Construct move history for a template */
-    if (is_tmplt) {
-        idx_history = 0;
-        for (i = 0; i < 81; ++i) {
-            if (0 != DIGIT(i)) {
-                history[idx_history++] = i | (DIGIT(i) << 8);
+        if (0 <= sv->branch_unit) {
+            u = sv->branch_unit;
+            digit = sv->branch_digit;
+            for (i = 0; !IS_EMPTY(sv, unit_cell[u][i])
+                        || DISALLOWED(sv, unit_cell[u][i], digit); ++i) {
+                ;
             }
+            best = unit_cell[u][i];
         }
     }
-    /* Finally, markup all of these moves as 'fixed' */
-    for (i = 0; i < idx_history; ++i) {
-        history[i] |= FIXED;
-    }
-    return 0;
+    return best;
 }
 
-/**
- **  Curses screen interface
- **/
-
-/* Screen geometry */
-#define SUDOKU_LINE   2
-#define TITLE_LINE    4
-#define TOP           6
-#define LEFT_LEFT     0
-#define LEFT_MIDDLE  15
-#define LEFT         27
-#define SUDOKU_POS   35
-#define BOTTOM       (TOP+3*4)
-#define RIGHT        (LEFT+3*8)
-#define LINE_SIZE    80
-#define STATUS_LINE  20
-#define FILE_LINE    21
-#define LAST_LINE    23
-
-/* Maintain some global state - current cursor position */
-static int curx;
-static int cury;
-
-static int have_status;  /* True (non-zero) if status line set */
-static int have_hint;    /* True (non-zero) If hint displayed */
-
-static char statusline[LINE_SIZE];  /* Buffer for status line */
-
-/* Render board background - assume 24x80 screen */
+/* Push a snapshot of the board for the choice about to be made. Any
+ * digits masked by the refining strategies are dropped, as they are by
+ * reapply().
+ */
 static
 void
-draw_screen (void)
+push_snapshot (solver_t * sv)
 {
+    snapshot_t * sp;
     int i;
 
-    wclear(stdscr);
-    attron(A_BOLD);
-    mvaddstr(SUDOKU_LINE, SUDOKU_POS, "Su-Do-Ku!");
-    attroff(A_BOLD);
-
-    for (i = 0; i < 3; ++i) {
-        mvaddstr(TOP + 0 + 4 * i, LEFT, "+-------+-------+-------+");
-        mvaddstr(TOP + 1 + 4 * i, LEFT, "|       |       |       |");
-        mvaddstr(TOP + 2 + 4 * i, LEFT, "|       |       |       |");
-        mvaddstr(TOP + 3 + 4 * i, LEFT, "|       |       |       |");
-    }
-    mvaddstr(TOP + 4 * 3, LEFT, "+-------+-------+-------+");
-
-    mvaddstr(TOP + 2, LEFT_LEFT + 1, "Rules:");
-    mvaddstr(TOP + 3, LEFT_LEFT + 2, "Fill the grid so that");
-    mvaddstr(TOP + 4, LEFT_LEFT + 2, "every column, row and");
-    mvaddstr(TOP + 5, LEFT_LEFT + 2, "3x3 box contains each");
-    mvaddstr(TOP + 6, LEFT_LEFT + 2, "of the digits 1 to 9.");
-    i = TOP + 7;
-    if (0 == opt_restrict) {
-        mvaddstr(++i, LEFT_LEFT + 1, "File:");
-        mvaddstr(++i, LEFT_LEFT + 2, "s   save board");
-        mvaddstr(++i, LEFT_LEFT + 2, "w   write template");
-        mvaddstr(++i, LEFT_LEFT + 2, "o   open board");
-        mvaddstr(++i, LEFT_LEFT + 2, "t   set board title");
+    assert(sv->depth < 81);
+    ++sv->guesses;
+    sp = &sv->stack[sv->depth++];
+    sp->idx_history = sv->idx_history;
+    sp->unit = -1;
+    sp->hash = sv->hash;
+    memcpy(sp->used, sv->used, sizeof(sp->used));
+    for (i = 0; i < 81; ++i) {
+        sp->cell[i] = (unsigned char)(DIGIT(sv, i)
+                                      | (IS_FIXED(sv, i) ? SNAP_FIXED : 0));
     }
-
-/*    mvaddstr(TOP - 1, RIGHT + 4, "Keys:"); */
-    mvaddstr(TOP + 0, RIGHT + 8, "k");
-    mvaddstr(TOP + 1, RIGHT + 4, "  h   l move cursor");
-    mvaddstr(TOP + 2, RIGHT + 8, "j");
-    mvaddstr(TOP + 3, RIGHT + 7, "1-9  place digit");
-    mvaddstr(TOP + 4, RIGHT + 7, "0 .  clear digit");
-    mvaddstr(TOP + 5, RIGHT + 8, "c   clear board");
-    mvaddstr(TOP + 6, RIGHT + 8, "d   redraw the board");
-    mvaddstr(TOP + 7, RIGHT + 8, "f   fix squares");
-    mvaddstr(TOP + 8, RIGHT + 8, "n   new board");
-    mvaddstr(TOP + 9, RIGHT + 8, "q   quit game");
-    i = TOP + 9;
-    mvaddstr(++i, RIGHT + 8, "r   restart");
-    mvaddstr(++i, RIGHT + 8, "u   undo last move");
-    mvaddstr(++i, RIGHT + 8, "v   solve");
-    mvaddstr(++i, RIGHT + 8, "?   request hint");
 }
 
-/* Write board title */
+/* Restore the board from a snapshot (c.f. reapply()) */
 static
 void
-write_title(const char * title)
+pop_snapshot (solver_t * sv, const snapshot_t * sp)
 {
-    move(TITLE_LINE, LEFT_LEFT);
-    wclrtoeol(stdscr);
-    if (0 != title) {
-        mvaddstr(TITLE_LINE,
-                 (int)((LINE_SIZE - strlen(title)) / 2),
-                 title);
+    int i;
+
+    memcpy(sv->used, sp->used, sizeof(sv->used));
+    sv->hash = sp->hash;
+    for (i = 0; i < 81; ++i) {
+        if (0 == sp->cell[i]) {
+            sv->board[i] = 0;
+        } else {
+            sv->board[i] = SET_DIGIT(sp->cell[i] & ~SNAP_FIXED) | STATE_MASK;
+            if (sp->cell[i] & SNAP_FIXED) {
+                sv->board[i] |= FIXED;
+            }
+        }
     }
+    mask_houses(sv);
+    sv->idx_history = sp->idx_history;
 }
 
-/* Move cursor to grid position, and force refresh */
+/* Choose a digit for the given square.
+ * The rank of the starting digit is passed as a parameter (c.f.
+ * RANK_DIGIT()). Returns -1 if no choice possible.
+ */
 static
-void
-move_to (int x, int y)
+int
+choose (solver_t * sv, int idx, int rank)
 {
-    curx = x;
-    cury = y;
-
-    move(TOP + 1 + y + y / 3,
-         LEFT + 2 + 2 * (x + x / 3));
-
-    wrefresh(stdscr);
+    int digit;
+
+    for (; rank <= 9; ++rank) {
+        digit = RANK_DIGIT(sv, rank);
+        if (!DISALLOWED(sv, idx, digit)) {
+            push_snapshot(sv);
+            sv->board[idx] = SET_DIGIT(digit);
+            update(sv, idx);
+            append_move(sv, idx, digit, CHOICE);
+            if (0 != (sv->strategies & STRATEGY_BACKJUMP)) {
+                memset(&sv->dep[idx], 0x00, sizeof(sv->dep[idx]));
+                levels_add(&sv->dep[idx], sv->depth);
+            }
+            return digit;
+        }
+    }
+    return -1;
 }
 
-/* Move cursor to next non-fixed square, and force refresh */
-void
+/* Having backtracked chronologically (e.g. past a solution), no level
+ * may be skipped by backjump() later: blame each on the one before.
+ */
 static
-move_next (void)
+void
+chronological (solver_t * sv)
 {
-    int is_loop = 0;
-    do {
-        if (curx < 8) {
-            move_to(curx + 1, cury);
-        } else if (cury < 8) {
-            move_to(0, cury + 1);
-        } else {
-            move_to(0, 0);
-            if (is_loop++ > 0) {
-                /* We can get here if the user attempts to load a fully
-                 * populated board. In that case it's better to break.  */
-                break;
-            }
+    int level;
+
+    if (0 != (sv->strategies & STRATEGY_BACKJUMP)) {
+        for (level = 1; level <= sv->depth; ++level) {
+            levels_upto(&sv->conflict[level], level - 1);
         }
-     } while (IS_FIXED(INDEX(cury, curx)));
+    }
 }
 
-/* Render status line */
+/* Choose a position in the unit for the given digit, from position
+ * 'start' onwards. Returns -1 if no choice possible, else the index of
+ * the square filled.
+ */
 static
-void
-set_status (const char * txt)
+int
+choose_position (solver_t * sv, int unit, int digit, int start)
 {
-    mvaddstr(STATUS_LINE,
-             (int)((LINE_SIZE - strlen(txt)) / 2),
-             (char *)txt);
+    int i, idx;
 
-    move_to(curx, cury);
-    wrefresh(stdscr);
-    have_status = 1;
+    for (i = start; i < 9; ++i) {
+        idx = unit_cell[unit][i];
+        if (IS_EMPTY(sv, idx) && !DISALLOWED(sv, idx, digit)) {
+            push_snapshot(sv);
+            sv->stack[sv->depth - 1].unit = unit;
+            sv->board[idx] = SET_DIGIT(digit);
+            update(sv, idx);
+            append_move(sv, idx, digit, CHOICE);
+            return idx;
+        }
+    }
+    return -1;
 }
 
+/* Make the choice found by choice() */
 static
-void
-clear_status (void)
+int
+branch (solver_t * sv, int idx)
 {
-    move(STATUS_LINE, LEFT_LEFT);
-    wclrtoeol(stdscr);
-    move_to(curx, cury);
-    have_status = 0;
+    if (0 <= sv->branch_unit) {
+        return choose_position(sv, sv->branch_unit, sv->branch_digit, 0);
+    }
+    return choose(sv, idx, 1);
 }
 
-/* Show meassge in the status line for 2 seconds */
+/* Backtrack to a previous choice point, and attempt to reseed
+ * the search. Return -1 if no further choice possible, or
+ * the index of the changed square.
+ *
+ * Choice points are normally undone by restoring the snapshot taken
+ * by choose(). Should the snapshot stack have been discarded (e.g. by
+ * reapply()), fall back to rewinding the move history, and replaying
+ * it to rebuild the board. Note that the first move is never treated
+ * as a choice point.
+ *
+ * Assumes that the move history and board are valid.
+ */
 static
-void
-status_message (const char * txt)
+int
+backtrack (solver_t * sv)
 {
-    beep();
-    set_status(txt);
-    usleep(2000000);
-    clear_status();
+    int digit, idx, unit, i;
+
+    while (0 < sv->depth) {
+        const snapshot_t * sp = &sv->stack[--sv->depth];
+        if (0 == sp->idx_history) {
+            sv->idx_history = 0;
+            return -1;
+        }
+        pop_snapshot(sv, sp);
+        idx = GET_INDEX(sv->history[sv->idx_history]);
+        digit = GET_DIGIT(sv->history[sv->idx_history]);
+        unit = sp->unit;
+        if (0 <= unit) {
+            /* Digit choice: try the next position in the unit */
+            for (i = 0; unit_cell[unit][i] != idx; ++i) {
+                ;
+            }
+            idx = choose_position(sv, unit, digit, i + 1);
+            if (-1 != idx) {
+                chronological(sv);
+                return idx;
+            }
+        } else if (-1 != choose(sv, idx, DIGIT_RANK(sv, digit) + 1)) {
+            chronological(sv);
+            return idx;
+        }
+    }
+    for (; 0 < --sv->idx_history;) {
+        if (sv->history[sv->idx_history] & CHOICE) {
+            /* Remember the last choice, and advance */
+            idx = GET_INDEX(sv->history[sv->idx_history]);
+            digit = GET_DIGIT(sv->history[sv->idx_history]);
+            reapply(sv);
+            if (-1 != choose(sv, idx, DIGIT_RANK(sv, digit) + 1)) {
+                chronological(sv);
+                return idx;
+            }
+        }
+    }
+    return -1;
 }
 
-/* Beep and show meassge in the status line for 2 seconds */
+/* Conflict-directed backjumping: each filled square records the choice
+ * levels it depends on (c.f. explain()), so a contradiction can be blamed
+ * on the choices that caused it, and the search can jump straight back
+ * to the latest of those. Conflicts are also learned as nogoods, which
+ * rule out digits completing them in later choices.
+ */
+
+/* Blame for the digits masked for the empty square 'idx' */
 static
 void
-beep_status_message (const char * txt)
+excluded_digits (solver_t * sv, int idx, levels_t * set)
 {
-    beep();
-    status_message(txt);
+    int digit;
+
+    memset(set, 0x00, sizeof(*set));
+    for (digit = 1; digit <= 9; ++digit) {
+        if (DISALLOWED(sv, idx, digit)
+            && -1 == excluded_by(sv, idx, digit, set)) {
+            levels_upto(set, sv->depth);
+            return;
+        }
+    }
 }
 
-/* Render current board */
+/* Blame for a contradiction on the board: a square with no digit left,
+ * or a digit with no place left in a unit, else every choice so far.
+ */
 static
 void
-render (void)
+conflict_set (solver_t * sv, levels_t * set)
 {
-    int i, x, y;
+    int i, u, idx, digit, missing;
 
-    for (i = 0; i < 81; ++i) {
-        x = LEFT + 2 + 2 * (COLUMN(i) + COLUMN(i) / 3);
-        y = TOP + 1 + ROW(i) + ROW(i) / 3;
-        assert(0 <= DIGIT(i));
-        assert(DIGIT(i) <= 9); /* XXX FAILING */
-        if (IS_FIXED(i)) {
-            attron(A_BOLD);
+    for (idx = 0; idx < 81; ++idx) {
+        if (IS_EMPTY(sv, idx) && STATE_MASK == STATE(sv, idx)) {
+            excluded_digits(sv, idx, set);
+            return;
         }
-        if (IS_EMPTY(i)) {
-            mvaddch(y, x, '.');
-        } else {
-            mvaddch(y, x, '0' + DIGIT(i));
+    }
+    memset(set, 0x00, sizeof(*set));
+    for (u = 0; u < MAX_UNITS; ++u) {
+        if (27 <= u && 0 == (sv->houses & HOUSE_BIT(u))) {
+            continue;
         }
-        if (IS_FIXED(i)) {
-            attroff(A_BOLD);
+        missing = STATE_MASK & ~sv->used[u];
+        for (i = 0; 0 != missing && i < 9; ++i) {
+            idx = unit_cell[u][i];
+            if (IS_EMPTY(sv, idx)) {
+                missing &= STATE(sv, idx);
+            }
+        }
+        if (0 != missing) {
+            digit = 1 + numset((missing & -missing) - 1);
+            for (i = 0; i < 9; ++i) {
+                if (-1 == excluded_by(sv, unit_cell[u][i], digit, set)) {
+                    break;
+                }
+            }
+            if (i < 9) {
+                break;
+            }
+            return;
         }
     }
+    levels_upto(set, sv->depth);
 }
 
+/* Learn the choices blamed for a conflict as a nogood */
 static
 void
-row_hint (int row)
+learn (solver_t * sv, const levels_t * set)
 {
-    mvaddch(TOP + 1 + row + row / 3, LEFT - 2, '>');
-    mvaddch(TOP + 1 + row + row / 3, RIGHT + 2, '<');
-    move_to(curx, cury);
-    have_hint = 1;
+    nogood_t nogood;
+    int level, move;
+
+    nogood.n = 0;
+    for (level = 1; level <= sv->depth; ++level) {
+        if (0 != (set->w[level >> 5] & (1u << (level & 31)))) {
+            if (NOGOOD_SIZE == nogood.n) {
+                return;
+            }
+            move = sv->history[sv->stack[level - 1].idx_history];
+            nogood.lit[nogood.n++] = (short)(9 * GET_INDEX(move)
+                                             + GET_DIGIT(move) - 1);
+        }
+    }
+    if (0 < nogood.n) {
+        sv->nogood[sv->idx_nogood] = nogood;
+        sv->idx_nogood = (sv->idx_nogood + 1) % NOGOODS;
+    }
 }
 
+/* Would 'digit' in square 'idx' complete a nogood? If so, add the
+ * blame for the rest of the nogood to 'set' and return 1, else 0.
+ */
 static
-void
-column_hint (int col)
+int
+blocked (solver_t * sv, int idx, int digit, levels_t * set)
 {
-    mvaddch(TOP - 1, LEFT + 2 + 2 * (col + col / 3), 'v');
-    mvaddch(BOTTOM + 1, LEFT + 2 + 2 * (col + col / 3), '^');
-    move_to(curx, cury);
-    have_hint = 1;
+    const int lit = 9 * idx + digit - 1;
+    int i, j, found, holds;
+
+    for (i = 0; i < NOGOODS; ++i) {
+        const nogood_t * ng = &sv->nogood[i];
+        for (found = 0, holds = 1, j = 0; holds && j < ng->n; ++j) {
+            if (lit == ng->lit[j]) {
+                found = 1;
+            } else {
+                holds = DIGIT(sv, ng->lit[j] / 9) == 1 + ng->lit[j] % 9;
+            }
+        }
+        if (found && holds) {
+            for (j = 0; j < ng->n; ++j) {
+                if (lit != ng->lit[j]) {
+                    levels_merge(set, &sv->dep[ng->lit[j] / 9]);
+                }
+            }
+            return 1;
+        }
+    }
+    return 0;
 }
 
+/* Choose a digit for the given square, from rank 'rank' onwards,
+ * skipping those that complete a nogood. On entry 'set' blames the digits
+ * ruled out so far, and becomes the conflict set of the new level;
+ * returns -1 if no choice possible, with 'set' blaming every digit.
+ */
 static
-void
-block_hint (int block)
+int
+jump_choose (solver_t * sv, int idx, int rank, levels_t * set)
 {
-    int i, j;
-    for (i = 0; i < 3; ++i) {
-        j = 3 * (block / 3) + i;
-        mvaddch(TOP + 1 + j + j / 3, LEFT - 2, '>');
-        mvaddch(TOP + 1 + j + j / 3, RIGHT + 2, '<');
-        j = 3 * (block % 3) + i;
-        mvaddch(TOP - 1, LEFT + 2 + 2 * (j + j / 3), 'v');
-        mvaddch(BOTTOM + 1, LEFT + 2 + 2 * (j + j / 3), '^');
+    int digit;
+
+    for (; rank <= 9; ++rank) {
+        digit = RANK_DIGIT(sv, rank);
+        if (!DISALLOWED(sv, idx, digit) && !blocked(sv, idx, digit, set)) {
+            choose(sv, idx, rank);
+            sv->conflict[sv->depth] = *set;
+            return digit;
+        }
     }
-    move_to(curx, cury);
-    have_hint = 1;
+    return -1;
 }
 
+/* Backjump to the latest choice blamed (in 'set') for a contradiction,
+ * abandoning those after it, and try its next digit. Returns -1 if no
+ * further choice possible, or the index of the changed square.
+ */
 static
-void
-clear_hints (void)
+int
+backjump (solver_t * sv, levels_t * set)
 {
-    int i;
-    for (i = 0; i < 9; ++i) {
-        mvaddch(TOP + 1 + i + i / 3, LEFT - 2, ' ');
-        mvaddch(TOP + 1 + i + i / 3, RIGHT + 2, ' ');
-        mvaddch(TOP - 1, LEFT + 2 + 2 * (i + i / 3), ' ');
-        mvaddch(BOTTOM + 1, LEFT + 2 + 2 * (i + i / 3), ' ');
+    int level, idx, digit;
+
+    learn(sv, set);
+    while (0 < sv->depth) {
+        const snapshot_t * sp = &sv->stack[--sv->depth];
+        level = sv->depth + 1;
+        if (0 == sp->idx_history) {
+            sv->idx_history = 0;
+            return -1;
+        }
+        pop_snapshot(sv, sp);
+        if (0 != (set->w[level >> 5] & (1u << (level & 31)))) {
+            set->w[level >> 5] &= ~(1u << (level & 31));
+            levels_merge(set, &sv->conflict[level]);
+            idx = GET_INDEX(sv->history[sv->idx_history]);
+            digit = GET_DIGIT(sv->history[sv->idx_history]);
+            if (-1 != jump_choose(sv, idx, DIGIT_RANK(sv, digit) + 1, set)) {
+                return idx;
+            }
+        }
     }
-    have_hint = 0;
-    move_to(curx, cury);
+    /* Any choices left are older than the snapshots */
+    return backtrack(sv);
 }
 
-/* Fix all squares - if possible.
- * Returns -1 on error, in which case there is an error in the
- * current board; otherwise returns 0 if all is OK.
+/* Look-ahead before choosing a digit for the given square: try each
+ * allowed digit on the board and run the deterministic solver; any
+ * digit leading to a contradiction is masked for the square. The board
+ * is otherwise left as it was. Returns the # digits masked.
  */
 static
 int
-fix (void)
+probe (solver_t * sv, int idx)
 {
-    int i;
+    int board[81], used[MAX_UNITS];
+    int idx_history = sv->idx_history, pass = sv->pass;
+    zkey_t hash = sv->hash;
+    int i, digit, failed, n = 0;
 
-    if (0 == reapply()) {
-        compress(idx_history);
-        for (i = 0; i < idx_history; ++i) {
-            history[i] |= FIXED;
+    memcpy(board, sv->board, sizeof(board));
+    memcpy(used, sv->used, sizeof(used));
+    for (digit = 1; digit <= 9; ++digit) {
+        if (DISALLOWED(sv, idx, digit)) {
+            continue;
         }
-        reapply();
-        render();
-        if (idx_history < 81 && IS_FIXED(INDEX(cury, curx))) {
-            move_next();
-        } else {
-            move_to(curx, cury);
+        sv->board[idx] = SET_DIGIT(digit);
+        update(sv, idx);
+        append_move(sv, idx, digit, CHOICE);
+        failed = -1 == deterministic(sv);
+        for (i = 0; !failed && i < 81; ++i) {
+            /* Inconsistency if square unknown, but nothing possible */
+            failed = IS_EMPTY(sv, i) && STATE_MASK == STATE(sv, i);
+        }
+
+        memcpy(sv->board, board, sizeof(board));
+        memcpy(sv->used, used, sizeof(used));
+        sv->idx_history = idx_history;
+        sv->pass = pass;
+        sv->hash = hash;
+        if (failed) {
+            board[idx] |= DIGIT_STATE(digit);
+            sv->board[idx] = board[idx];
+            ++n;
         }
-        return 0;
-    } else {
-        return -1;
     }
+    return n;
 }
 
-/* Limit factor definitions for the classification. */
-#define LIMIT_FACTOR_VERY_EASY  15
-#define LIMIT_FACTOR_EASY       11
-#define LIMIT_FACTOR_MEDIUM     7
-#define LIMIT_FACTOR_HARD       4
-#define LIMIT_FACTOR_FIENDISH   0
-
-static const char *     NAME_VERY_EASY  = "very easy";
-static const char *     NAME_EASY       = "easy";
-static const char *     NAME_MEDIUM     = "medium";
-static const char *     NAME_HARD       = "hard";
-static const char *     NAME_FIENDISH   = "fiendish";
-
-/* Class limit and name for the classification. */
-#define CL(ct)   ((LIMIT_FACTOR_##ct) * pass)
-#define CN(ct)    NAME_##ct
-
+/* Attempt to solve 'board'; return 0 on success else -1 on error.
+ *
+ * The solution process attempts to fill-in deterministically as
+ * much of the board as possible. Once that is no longer possible,
+ * need to choose a square to fill in.
+ */
 static
-const char *
-class_name_by_score (int score)
+int
+solve (solver_t * sv)
 {
-    const char * name;
-    if (CL(VERY_EASY) < score) {
-        name = CN(VERY_EASY);
-    } else if (CL(EASY) < score) {
-        name = CN(EASY);
-    } else if (CL(MEDIUM) < score) {
-        name = CN(MEDIUM);
-    } else if (CL(HARD) < score) {
-        name = CN(HARD);
-    } else {
-        name = CN(FIENDISH);
+    levels_t set;
+    int idx;
+
+    for (;;) {
+        if (0 != sv->budget && sv->guesses > sv->budget) {
+            /* Out of guesses: give up */
+            idx = -1;
+            break;
+        }
+        if (0 == deterministic(sv)) {
+            /* Solved, make a new choice, or rewind a previous choice */
+            idx = choice(sv);
+            if (-1 == idx) {
+                idx = 0;
+                break;
+            } else if (0 <= idx && 0 != (sv->strategies & STRATEGY_PROBE)
+                       && 0 < probe(sv, idx)) {
+                /* Digits masked: carry on deterministically */
+                continue;
+            } else if (0 != (sv->strategies & STRATEGY_BACKJUMP)) {
+                if (idx < 0) {
+                    conflict_set(sv, &set);
+                } else {
+                    excluded_digits(sv, idx, &set);
+                }
+                if ((idx < 0 || -1 == jump_choose(sv, idx, 1, &set))
+                    && -1 == backjump(sv, &set)) {
+                    idx = -1;
+                    break;
+                }
+            } else if ((idx < 0 || -1 == branch(sv, idx))
+                       && -1 == backtrack(sv)) {
+                idx = -1;
+                break;
+            }
+        } else if (0 != (sv->strategies & STRATEGY_BACKJUMP)) {
+            /* jump back to the choice to blame */
+            conflict_set(sv, &set);
+            if (-1 == backjump(sv, &set)) {
+                idx = -1;
+                break;
+            }
+        } else {
+            /* rewind to a previous choice */
+            if (-1 == backtrack(sv)) {
+                idx = -1;
+                break;
+            }
+        }
     }
-    return name;
+    return idx;
 }
 
-/* Classify a SuDoKu, given its solution.
- *
- * The classification is based on the average number of possible moves
- * for each pass of the deterministic solver - it is a rather simplistic
- * measure, but gives reasonable results. Note also that the classification
- * is based on the first solution found (but does handle the pathological
- * case of multiple solutions). Note that the average moves per pass
- * depends just on the number of squares initially set... this simplifies
- * the statistics collection immensely, requiring just the number of passes
- * to be counted.
- *
- * Return 0 on error, else a string classification.
- */
+/**
+ **  Dancing links - Knuth's Algorithm X over the exact cover matrix
+ **/
 
+/* Build the full exact cover matrix, with the houses turned on */
 static
-const char *
-classify (void)
+void
+dlx_init (dlx_t * dp, int houses)
 {
-    int i, score;
-
-    pass = 0;
-    clear_moves();
-    if (-1 == solve()) {
-        return 0;
-    }
+    int i, k, n, col, cand, idx, digit, row, width, columns = 324;
+    int cols[DLX_WIDTH], first[MAX_UNITS];
 
-    score = 81;
-    for (i = 0; i < 81; ++i) {
-        if (IS_FIXED(i)) {
-            --score;
+    for (i = 27; i < MAX_UNITS; ++i) {
+        if (0 != (houses & HOUSE_BIT(i))) {
+            first[i] = 1 + columns;
+            columns += 9;
         }
     }
-    assert(81 == idx_history);
-
-    for (i = 0; i < 81; ++i) {
-        if (history[i] & CHOICE) {
-            score -= 5;
+    for (i = 0; i <= columns; ++i) {
+        dp->l[i] = (short)(0 == i ? columns : i - 1);
+        dp->r[i] = (short)(columns == i ? 0 : i + 1);
+        dp->u[i] = dp->d[i] = dp->c[i] = (short)i;
+        dp->s[i] = 0;
+    }
+    dp->width = 0 == houses ? 4 : DLX_WIDTH;
+    for (cand = 0; cand < DLX_ROWS; ++cand) {
+        idx = cand / 9;
+        digit = cand % 9;
+        cols[0] = 1 + idx;
+        cols[1] = 1 + 81 + 9 * ROW_UNIT(idx) + digit;
+        cols[2] = 1 + 81 + 9 * COLUMN_UNIT(idx) + digit;
+        cols[3] = 1 + 81 + 9 * BLOCK_UNIT(idx) + digit;
+        for (width = 4, k = 0; 0 != houses && k < 3; ++k) {
+            i = cell_house[idx][k];
+            if (0 != i && 0 != (houses & HOUSE_BIT(i))) {
+                cols[width++] = first[i] + digit;
+            }
+        }
+        row = DLX_FIRST_ROW + dp->width * cand;
+        for (k = 0; k < width; ++k) {
+            n = row + k;
+            col = cols[k];
+            dp->c[n] = (short)col;
+            dp->u[n] = dp->u[col];
+            dp->d[n] = (short)col;
+            dp->d[dp->u[col]] = (short)n;
+            dp->u[col] = (short)n;
+            ++dp->s[col];
+            dp->l[n] = (short)(row + (k + width - 1) % width);
+            dp->r[n] = (short)(row + (k + 1) % width);
         }
     }
-    return  class_name_by_score(score);
+    dp->level = 0;
 }
 
-/* exchange disjoint, identical length blocks of data */
+/* Remove a column, and all rows intersecting it, from the matrix */
 static
 void
-exchange (int * a, int * b, int len)
+dlx_cover (dlx_t * dp, int col)
 {
-    int i, tmp;
-    for (i = 0; i < len; ++i) {
-        tmp = a[i];
-        a[i] = b[i];
-        b[i] = tmp;
+    int i, j;
+
+    dp->r[dp->l[col]] = dp->r[col];
+    dp->l[dp->r[col]] = dp->l[col];
+    for (i = dp->d[col]; i != col; i = dp->d[i]) {
+        for (j = dp->r[i]; j != i; j = dp->r[j]) {
+            dp->u[dp->d[j]] = dp->u[j];
+            dp->d[dp->u[j]] = dp->d[j];
+            --dp->s[dp->c[j]];
+        }
     }
 }
 
-/* rotate left */
+/* Exact inverse of dlx_cover() */
 static
 void
-rotate1_left (int * a, int len)
+dlx_uncover (dlx_t * dp, int col)
 {
-    int i, tmp;
-    tmp = a[0];
-    for (i = 1; i < len; ++i) {
-        a[i - 1] = a[i];
+    int i, j;
+
+    for (i = dp->u[col]; i != col; i = dp->u[i]) {
+        for (j = dp->l[i]; j != i; j = dp->l[j]) {
+            ++dp->s[dp->c[j]];
+            dp->u[dp->d[j]] = (short)j;
+            dp->d[dp->u[j]] = (short)j;
+        }
     }
-    a[len - 1] = tmp;
+    dp->r[dp->l[col]] = (short)col;
+    dp->l[dp->r[col]] = (short)col;
 }
 
-/* rotate right */
+/* Remove the squares already filled on the board from the matrix.
+ * Returns 0 on success, or -1 if the filled squares conflict.
+ */
 static
-void
-rotate1_right (int * a, int len)
+int
+dlx_givens (solver_t * sv)
 {
-    int i, tmp;
-    tmp = a[len - 1];
-    for (i = len - 1; 0 < i; --i) {
-        a[i] = a[i - 1];
+    dlx_t * dp = &sv->dlx;
+    int i, j, n;
+
+    for (i = 0; i < 81; ++i) {
+        if (!IS_EMPTY(sv, i)) {
+            n = DLX_FIRST_ROW + dp->width * (9 * i + DIGIT(sv, i) - 1);
+            j = n;
+            do {
+                if (dp->r[dp->l[dp->c[j]]] != dp->c[j]) {
+                    return -1;  /* Constraint already satisfied */
+                }
+                j = dp->r[j];
+            } while (j != n);
+            do {
+                dlx_cover(dp, dp->c[j]);
+                j = dp->r[j];
+            } while (j != n);
+        }
     }
-    a[0] = tmp;
+    return 0;
 }
 
-/* Generalised left rotation - there is a naturally recursive
- * solution that is best implementation using iteration.
- * Note that it is not necessary to do repeated unit rotations.
+/* Run Algorithm X without recursion, so that the search can stop at each
+ * solution, and later resume from where it left off. The column with the
+ * fewest rows is chosen at each level.
  *
- * This function is analogous to 'cutting' a 'pack of cards'.
- *
- * On entry: 0 < idx < len
+ * Returns 0 when a solution is found, or -1 when the search is exhausted.
  */
 static
-void
-rotate (int * a, int len, int idx)
+int
+dlx_search (dlx_t * dp, int resume)
 {
-    int xdi = len - idx;
-    int delta = idx - xdi;
+    int col = 0, n = 0, j, best;
 
-    while (0 != delta && 0 != idx) {
-        if (delta < 0) {
-            if (1 == idx) {
-                rotate1_left(a, len);
-                idx = 0;
-            } else {
-                exchange(a, a + xdi, idx);
-                len = xdi;
+    for (;;) {
+        if (resume) {
+            /* Undo the last row, and try the next row in its column */
+            if (0 == dp->level) {
+                return -1;
             }
+            n = dp->o[--dp->level];
+            col = dp->c[n];
+            for (j = dp->l[n]; j != n; j = dp->l[j]) {
+                dlx_uncover(dp, dp->c[j]);
+            }
+            n = dp->d[n];
         } else {
-            /* 0 < delta */
-            if (1 == xdi) {
-                rotate1_right(a, len);
-                idx = 0;
-            } else {
-                exchange(a, a + idx, xdi);
-                a += xdi;
-                len = idx;
-                idx -= xdi;
+            if (0 == dp->r[0]) {
+                return 0;
+            }
+            best = DLX_ROWS + 1;
+            for (j = dp->r[0]; j != 0; j = dp->r[j]) {
+                if (dp->s[j] < best) {
+                    best = dp->s[j];
+                    col = j;
+                }
+            }
+            if (0 == best) {
+                resume = 1;
+                continue;
             }
+            dp->forced[dp->level] = (char)(1 == best);
+            dlx_cover(dp, col);
+            n = dp->d[col];
         }
-        xdi = len - idx;
-        delta = idx - xdi;
-    }
-    if (0 < idx) {
-        exchange(a, a + idx, idx);
+        if (n == col) {
+            dlx_uncover(dp, col);
+            resume = 1;
+            continue;
+        }
+        dp->o[dp->level++] = (short)n;
+        for (j = dp->r[n]; j != n; j = dp->r[j]) {
+            dlx_cover(dp, dp->c[j]);
+        }
+        resume = 0;
     }
 }
 
-/* Shuffle an array of integers */
+/* Write the current solution to the board, and the move history; the
+ * rows chosen from a column with a single row are recorded as
+ * deterministic moves, the others as choices.
+ */
 static
 void
-shuffle (int * a, int len)
+dlx_store (solver_t * sv)
 {
-    int i, j, tmp;
+    dlx_t * dp = &sv->dlx;
+    int i, cand, idx, digit;
+
+    sv->idx_history = dp->base;
+    reapply(sv);
+    for (i = 0; i < dp->level; ++i) {
+        cand = (dp->o[i] - DLX_FIRST_ROW) / dp->width;
+        idx = cand / 9;
+        digit = 1 + cand % 9;
+        sv->board[idx] = SET_DIGIT(digit);
+        update(sv, idx);
+        append_move(sv, idx, digit, dp->forced[i] ? 0 : CHOICE);
+    }
+    dp->state = DLX_SOLVED;
+}
 
-    i = len;
-    while (1 <= i) {
-        j = rand() % i;
-        tmp = a[--i];
-        a[i] = a[j];
-        a[j] = tmp;
+/* Exact cover counterpart of solve(); return 0 on success else -1.
+ * The first call after the board has changed builds the matrix; after
+ * dlx_backtrack(), the search continues to the next solution.
+ */
+static
+int
+dlx_solve (solver_t * sv)
+{
+    dlx_t * dp = &sv->dlx;
+    int resume = 0;
+
+    switch (dp->state) {
+        case DLX_SOLVED:
+            return 0;
+        case DLX_RESUME:
+            resume = 1;
+            break;
+        default:
+            dlx_init(dp, sv->houses);
+            dp->base = sv->idx_history;
+            if (-1 == dlx_givens(sv)) {
+                return -1;
+            }
+            break;
     }
+    if (-1 == dlx_search(dp, resume)) {
+        dp->state = DLX_IDLE;
+        return -1;
+    }
+    dlx_store(sv);
+    return 0;
 }
 
-/* Generate a SuDoKu puzzle
- *
- * The generation process selects a random template, and then attempts
- * to fill in the exposed squares to generate a board. The order of the
- * digits and of filling in the exposed squares are random.
+/* Exact cover counterpart of backtrack(); return -1 if no further choice
+ * is possible.
  */
+static
+int
+dlx_backtrack (solver_t * sv)
+{
+    dlx_t * dp = &sv->dlx;
+
+    if (DLX_SOLVED != dp->state || 0 == dp->level) {
+        return -1;
+    }
+    dp->state = DLX_RESUME;
+    return 0;
+}
 
-/* Select random template; sets tmplt, len_tmplt */
+/* Solve with the engine selected for the solver context. Note that the
+ * classification (c.f. classify()) always uses the deterministic solver.
+ */
 static
-void
-select_template (void)
+int
+engine_solve (solver_t * sv)
 {
-    int i = n_tmplt > 0 ? rand() % n_tmplt : 0;
-    tseek(ftmplt, 0, SEEK_SET);
-    while (0 <= i && 0 == read_board(ftmplt, 1)) {
-        --i;
+    if (eDLX == sv->engine) {
+        return dlx_solve(sv);
     }
+    return solve(sv);
 }
 
 static
-void
-generate (void)
+int
+engine_backtrack (solver_t * sv)
 {
-    static int digits[9];
+    if (eDLX == sv->engine) {
+        return dlx_backtrack(sv);
+    }
+    return backtrack(sv);
+}
 
-    int i;
+/* Fill in singles only (no refining strategies, nor pass counted);
+ * return 0, or -1 on a contradiction.
+ */
+static
+int
+fill_singles (solver_t * sv)
+{
+    int i, n;
 
-    for (;;) {
-        for (i = 0; i < 9; ++i) {
-            digits[i] = i + 1;
+    while (0 < (n = findmoves(sv))) {
+        for (i = 0; i < n; ++i) {
+            if (-1 == fill(sv, GET_INDEX(sv->possible[i]),
+                               GET_DIGIT(sv->possible[i]))) {
+                return -1;
+            }
         }
+    }
+    return n;
+}
 
-        rotate(digits, 9, 1 + rand() % 8);
-        shuffle(digits, 9);
-        select_template();
-
-        rotate(tmplt, len_tmplt, 1 + rand() % (len_tmplt - 1));
-        shuffle(tmplt, len_tmplt);
+/* log2 of 0..9 allowed digits, in tenths of a bit */
+static const unsigned char entropy_tenths[10] = {
+    0, 0, 10, 16, 20, 23, 26, 28, 30, 32
+};
 
-        reset();  /* construct a new board */
+/* Entropy left after singles (in tenths of a bit) below which -E auto
+ * picks backjumping rather than dancing links. Timing -s with 100 to
+ * 1000 came out within 2% over all boards tried; 250 was the fastest
+ * on the boards of the distribution.
+ */
+#define AUTO_ENTROPY            250
+
+/* Pick the engine for a board just read (-E auto). Singles are filled
+ * in on a copy of the board, in the scratch context 'trial': if that
+ * solves it or finds a contradiction, the search engine redoes just
+ * that. Otherwise the candidates left decide; backjumping wins with
+ * little entropy left, and dancing links beyond that (c.f.
+ * AUTO_ENTROPY). Counting alone (-C) is left to the search engine
+ * (c.f. count_completions()).
+ */
+static
+void
+dispatch (solver_t * sv, solver_t * trial)
+{
+    int i, n, empty = 0, entropy = 0;
 
-        for (i = 0; i < len_tmplt; ++i) {
-            fill(tmplt[i], digits[i % 9]);
-        }
-        if (0 != solve() || idx_history < 81) {
-            continue;
-        }
-        for (i = 0; i < len_tmplt; ++i) {
-            board[tmplt[i]] |= FIXED;
-        }
-        /* Construct fixed squares */
-        for (idx_history = i = 0; i < 81; ++i) {
-            if (IS_FIXED(i)) {
-                history[idx_history++] = SET_INDEX(i)
-                                         | SET_DIGIT(DIGIT(i))
-                                         | FIXED;
-            }
-        }
-        clear_moves();
+    memcpy(trial->board, sv->board, sizeof(trial->board));
+    memcpy(trial->used, sv->used, sizeof(trial->used));
+    memcpy(trial->history, sv->history, sizeof(trial->history));
+    trial->idx_history = sv->idx_history;
+    trial->houses = sv->houses;
+    n = fill_singles(trial);
 
-        if (0 != solve() || idx_history < 81) {
-            continue;
-        }
-        if (-1 != backtrack() && 0 == solve()) {
-            continue;
-        }
-        if (NULL != requested_class) {
-            const char * generated_class = classify();
-            sprintf(title, "randomly generated - %s", generated_class);
-            write_title(title);
-            wrefresh(stdscr);
-            if (0 != strcmp(requested_class, generated_class)) {
-                continue;
-            }
+    for (i = 0; i < 81; ++i) {
+        if (IS_EMPTY(trial, i)) {
+            ++empty;
+            entropy += entropy_tenths[numset(STATE_MASK
+                                             & ~STATE(trial, i))];
         }
-
-        break;
     }
+    if (-1 == n || 0 == empty) {
+        sv->engine = eSearch;
+    } else if (entropy < AUTO_ENTROPY) {
+        sv->engine = eBackjump;
+    } else {
+        sv->engine = eDLX;
+    }
+    sv->strategies &= ~STRATEGY_BACKJUMP;
+    if (eBackjump == sv->engine) {
+        sv->strategies |= STRATEGY_BACKJUMP;
+    }
+}
 
-    strcpy(title, "randomly generated - ");
-    strcat(title, classify());
+/* Count the solutions to a given board, stopping once 'limit' have
+ * been found (a limit of 0 counts them all). Returns the number of
+ * solutions found (0 if none), so a board is proper when counting up
+ * to 2 returns 1.
+ */
+static
+int
+count_solutions (solver_t * sv, int limit)
+{
+    int count = 0;
+    if (-1 != engine_solve(sv)) {
+        do {
+            ++count;
+        } while (count != limit
+                 && -1 != engine_backtrack(sv) && -1 != engine_solve(sv));
+    }
+    return count;
+}
 
-    clear_moves();
-    time(&start_time);
+/* Next key of a fixed sequence (splitmix64); not the random numbers of
+ * rng, so as not to disturb the boards generated.
+ */
+static
+zkey_t
+next_key (zkey_t * x)
+{
+    zkey_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
 }
 
-/* Support for explicitly opened board */
-static FILE * opened;
+/* Random numbers (xoshiro256**). Each board generated has a stream of
+ * its own, drawn from the seed of the run (-S) and the number of the
+ * board, so that a run can be repeated, or split between processes or
+ * threads, and still give the same boards. The game draws from 'rng'.
+ */
+typedef struct rng_s {
+    zkey_t  s[4];
+} rng_t;
 
-/* Support for precanned board (optional) */
-static FILE * precanned;
-static int n_precanned;
-static int completed;
+static rng_t rng;
+static zkey_t rng_base;             /* Seed of the run (-S), or random  */
 
+/* Start the stream of board 'k' of the run */
 static
-int
-open_precanned (const char * filename)
+void
+rng_seed (rng_t * r, zkey_t k)
 {
-    n_precanned = 0;
-    precanned = fopen(filename, "r");
-    if (0 != precanned) {
-        while (0 == read_board(precanned, 0)) {
-            ++n_precanned;
-        }
+    zkey_t x = k;
+    int i;
+
+    x = rng_base ^ next_key(&x);
+    for (i = 0; i < 4; ++i) {
+        r->s[i] = next_key(&x);
     }
-    /* return 0 on success, -1 on failure. */
-    return (n_precanned > 0) - 1;
 }
 
 static
-void
-open_template (const char * filename)
+zkey_t
+rng_next (rng_t * r)
 {
-    n_tmplt = 0;
-    ftmplt = topen(filename, "r");
-    if (0 != ftmplt) {
-        while (0 == read_board(ftmplt, 1)) {
-            ++n_tmplt;
-        }
-    }
+    zkey_t * s = r->s;
+    zkey_t x = s[1] * 5;
+    zkey_t t = s[1] << 17;
+
+    x = ((x << 7) | (x >> 57)) * 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return x;
 }
 
+/* Random number in 0 .. n-1 (n > 0), without the bias of a modulo */
 static
 int
-is_complete (void)
+rng_below (rng_t * r, int n)
 {
-    int i;
-    for (i = 0; i < 81 && !IS_EMPTY(i); ++i) {
-        /* counting the non-empty squares. */
+    zkey_t m = (rng_next(r) >> 32) * (zkey_t)n;
+
+    if ((unsigned int)m < (unsigned int)n) {
+        unsigned int floor = (unsigned int)-n % (unsigned int)n;
+        while ((unsigned int)m < floor) {
+            m = (rng_next(r) >> 32) * (zkey_t)n;
+        }
     }
-   return (81 == i);
+    return (int)(m >> 32);
 }
 
-/* load a new board - this could be a precanned board,
- * or a randomly generated board - chose between these
- * randomly -- 1 in 3 chance of loading a precanned
- * board (if they exist).
+/* Fill the Zobrist keys (c.f. update()). The key of a digit in a square
+ * combines a key for the square being filled with keys for the digit
+ * being used in its row, column and block: so the hash only tells which
+ * squares are filled, and which digits each unit holds. That is all the
+ * solutions left depend on, and boards differing by swapping digits
+ * around (e.g. in a rectangle of 4 squares) hash the same. Key 0 of
+ * each square, for no digit, stays 0. The houses of variants have keys
+ * of their own (c.f. update()), drawn after these.
  */
 static
 void
-load_board (void)
+init_zobrist (void)
 {
-    int i = 0;
-    if (opened) {
-        /* Select next board */
-        i = read_board(opened, 0);
-        if (i--) {
-            fclose(opened);
-            opened = NULL;
+    zkey_t unit[27][10];
+    zkey_t x = 0;
+    zkey_t square;
+    int i, d;
+
+    for (i = 0; i < 27; ++i) {
+        for (d = 1; d <= 9; ++d) {
+            unit[i][d] = next_key(&x);
         }
-    } else if (precanned &&
-               (0 == opt_random ||
-                (0 == rand() % 3 && 0 < n_precanned))) {
-        /* Select random board */
-        i = rand() % n_precanned;
-        fseek(precanned, 0, SEEK_SET);
-        while (0 <= i && 0 == read_board(precanned, 0)) {
-            --i;
+    }
+    for (i = 0; i < 81; ++i) {
+        square = next_key(&x);
+        for (d = 1; d <= 9; ++d) {
+            zobrist[i][d] = square ^ unit[ROW_UNIT(i)][d]
+                            ^ unit[COLUMN_UNIT(i)][d]
+                            ^ unit[BLOCK_UNIT(i)][d];
         }
     }
-    if (i != -1) {
-        set_status("generating a random board... (please wait)");
-        generate();
-        clear_status();
+    for (i = 0; i < MAX_UNITS - 27; ++i) {
+        for (d = 0; d <= 9; ++d) {
+            zobrist_house[i][d] = next_key(&x);
+        }
     }
+}
 
-    /* Shameless plug... */
-    set_status("Su-Do-Ku by Michael Kennett");
 
-    render();
-    write_title(title);
+/* Look up the count below the board with the given hash; returns the
+ * bound (TT_EMPTY if not found), and the count in 'count'.
+ */
+static
+int
+tt_probe (zkey_t hash, int * count)
+{
+    const tt_entry_t * tp = &ttable[hash & ((1 << TT_BITS) - 1)];
+    zkey_t check = TT_LOAD(&tp->check);
+    zkey_t data = TT_LOAD(&tp->data);
 
-    curx = cury = 8;    /* move_next() takes care of this... */
-    move_next();
-    completed = is_complete();
-    num_hints = -1;
-    time(&start_time);
+    if ((check ^ data) != hash) {
+        return TT_EMPTY;
+    }
+    *count = (int)(data & 0xffffffffU);
+    return (int)(data >> 32);
 }
 
-/* Manage rich text input (define 'virtual' key codes)
- * See the console(4) manpage.
+/* Record the count below the board with the given hash; the entry is
+ * always replaced, as the most recent subtrees are the likeliest hits.
  */
+static
+void
+tt_store (zkey_t hash, int count, int bound)
+{
+    tt_entry_t * tp = &ttable[hash & ((1 << TT_BITS) - 1)];
+    zkey_t data = (zkey_t)(unsigned int)count | (zkey_t)bound << 32;
 
-#define VKEY_IGNORE     (256)
-#define VKEY_UP         (256+'A')
-#define VKEY_DOWN       (256+'B')
-#define VKEY_RIGHT      (256+'C')
-#define VKEY_LEFT       (256+'D')
-#define VKEY_HOME       (256+'H')
-#define VKEY_INSERT     (256+'2')
-#define VKEY_DELETE     (256+'3')
-#define VKEY_END        (256+'4')
-#define VKEY_PGUP       (256+'5')
-#define VKEY_PGDOWN     (256+'6')
-#define VKEY_BACK       (0x08)
-
+    TT_STORE(&tp->check, hash ^ data);
+    TT_STORE(&tp->data, data);
+}
 
+/* Count the solutions to a given board like count_solutions(), but
+ * memoizing the count below each board state reached (c.f. ttable).
+ * Different guesses often leave the same squares to fill with the same
+ * digits, and only the first time is that subtree searched; this is
+ * what makes counting the solutions of boards with few clues feasible.
+ * With that, filling in just singles beats the refining strategies.
+ * The board is left with the singles filled in.
+ */
 static
 int
-getkey (void)
+count_completions (solver_t * sv, int limit)
 {
-    int ch = wgetch(stdscr);
-    if (0x1b == ch) {
-        ch = wgetch(stdscr);
-        if ('[' == ch) {
-            ch = wgetch(stdscr);
-            switch (ch) {
-                case 'A': ch = VKEY_UP;     break;
-                case 'B': ch = VKEY_DOWN;   break;
-                case 'C': ch = VKEY_RIGHT;  break;
-                case 'D': ch = VKEY_LEFT;   break;
-                case 'H': ch = VKEY_HOME;   break;
-                case '2': ch = VKEY_INSERT; break;
-                case '3': ch = VKEY_DELETE; break;
-                case '4': ch = VKEY_END;    break;
-                case '5': ch = VKEY_PGUP;   break;
-                case '6': ch = VKEY_PGDOWN; break;
-                default:  ch = VKEY_IGNORE;
-            }
-            if (ch == VKEY_HOME ||
-                ch == VKEY_DELETE ||
-                ch == VKEY_INSERT ||
-                ch == VKEY_END ||
-                ch == VKEY_PGUP ||
-                ch == VKEY_PGDOWN) {
-                int ch4 = wgetch(stdscr);
-                if (ch4 != '~') {
-                    ch = VKEY_IGNORE;
-                }
-            }
-        } else {
-            /* Enabling the Esc Esc sequence to produce one Esc character */
-            if (0x1b != ch) {
-                ch = VKEY_IGNORE;
-            }
+    int board[81], used[MAX_UNITS];
+    int idx_history, idx, digit, n, bound, count = 0;
+    zkey_t hash;
+
+    if (-1 == fill_singles(sv)) {
+        return 0;
+    }
+    idx = choice(sv);
+    if (-1 == idx) {
+        return 1;                   /* Solved */
+    } else if (idx < 0) {
+        return 0;                   /* Inconsistent */
+    }
+
+    bound = tt_probe(sv->hash, &count);
+    if (TT_EXACT == bound || (TT_LOWER == bound && count >= limit)) {
+        return count < limit ? count : limit;
+    }
+    count = 0;
+
+    memcpy(board, sv->board, sizeof(board));
+    memcpy(used, sv->used, sizeof(used));
+    idx_history = sv->idx_history;
+    hash = sv->hash;
+    for (digit = 1; digit <= 9 && count < limit; ++digit) {
+        if (DISALLOWED(sv, idx, digit)) {
+            continue;
         }
+        sv->board[idx] = SET_DIGIT(digit);
+        update(sv, idx);
+        append_move(sv, idx, digit, CHOICE);
+        n = count_completions(sv, limit - count);
+        count += n;
+
+        memcpy(sv->board, board, sizeof(board));
+        memcpy(sv->used, used, sizeof(used));
+        sv->idx_history = idx_history;
+        sv->hash = hash;
     }
-    return ch;
+
+    tt_store(hash, count, count < limit ? TT_EXACT : TT_LOWER);
+    return count;
 }
 
-/* Save board representation - the difficulty is managing the user interface
- * (i.e. finding where to save), with a tad more work involved in allowing
- * the board to be written to an arbitrary process.
- *
- * Persist the user filename.
+/* Complete a given board like count_completions() does, but without
+ * memoizing, and stopping at the first solution, which the board is
+ * left with. Returns 0, or -1 if there is no solution.
  */
-#if !defined (PATH_MAX)
-/* If it is not defined by the operating system, we can safely define it,
- * since the code below has no strong dependence on the current working
- * directory, for which it is solely used. */
-#define PATH_MAX 1024
-#endif
+static
+int
+first_completion (solver_t * sv)
+{
+    int board[81], used[MAX_UNITS];
+    int idx_history, idx, digit;
+    zkey_t hash;
 
-static char userfile[PATH_MAX];
-static char templatefile[PATH_MAX];
+    if (-1 == fill_singles(sv)) {
+        return -1;
+    }
+    idx = choice(sv);
+    if (-1 == idx) {
+        return 0;                   /* Solved */
+    } else if (idx < 0) {
+        return -1;                  /* Inconsistent */
+    }
 
-typedef struct edit_s {
-    char *  eb;         /* edit buffer                                  */
-    size_t  ebs;        /* edit buffer size                             */
-    size_t  efs;        /* edit field horizontal size                   */
-    int     efx;        /* edit field horizontal position               */
-    int     efy;        /* edit field vertical position                 */
-    int     ecn;        /* actual number of characters (including '\0') */
-    int     ecp;        /* edit position in the buffer                  */
-    int     x_0;        /* prompt position on the display               */
-    int     x_1;        /* first text position on the display           */
-    int     x_2;        /* last txt position on display                 */
-    int     x_3;        /* continuation marker position on display      */
-    int     x_mv;       /* maximal number of visible chars on display   */
-    int     m_0;        /* first editable char position in the buffer   */
-    int     m_1;        /* first visible char position in the buffer    */
-    int     prompt;     /* currently displayed prompt character         */
-    int     dprompt;    /* default prompt character                     */
-    int     eol_mark;   /* line continuation marker                     */
-    int     ins_mode;   /* insert mode                                  */
-    int     ch;         /* actual character for processing              */
-} edit_t;
+    memcpy(board, sv->board, sizeof(board));
+    memcpy(used, sv->used, sizeof(used));
+    idx_history = sv->idx_history;
+    hash = sv->hash;
+    for (digit = 1; digit <= 9; ++digit) {
+        if (DISALLOWED(sv, idx, digit)) {
+            continue;
+        }
+        sv->board[idx] = SET_DIGIT(digit);
+        update(sv, idx);
+        append_move(sv, idx, digit, CHOICE);
+        if (0 == first_completion(sv)) {
+            return 0;
+        }
 
+        memcpy(sv->board, board, sizeof(board));
+        memcpy(sv->used, used, sizeof(used));
+        sv->idx_history = idx_history;
+        sv->hash = hash;
+    }
+    return -1;
+}
 
-/* Init edit text data.
- * The ep pointer must point to a valid memory location.
+#if defined (HAVE_THREADS)
+/* Parallel counting (-p): a pool of workers, each with a solver context
+ * and a deque of tasks. A task is a board to count the solutions of.
+ * A worker takes its own tasks from the bottom of its deque, and when
+ * out of them steals from the top of the others'. While any worker is
+ * idle, a worker at a choice point hands the other digits over as tasks
+ * (c.f. count_task()), so the tree is split just as far as needed to
+ * keep all of them busy.
  */
+#define MAX_THREADS             64
+#define DEQUE_SIZE              64
+
+typedef struct task_s {
+    int     board[81];
+    int     used[MAX_UNITS];
+    zkey_t  hash;
+} task_t;
+
+typedef struct worker_s {
+    pthread_t       thread;
+    pthread_mutex_t lock;           /* Guards the deque                  */
+    int             top;            /* Thieves take tasks from the top   */
+    int             bottom;         /* .. and the owner from the bottom  */
+    task_t          deque[DEQUE_SIZE];
+    unsigned int    seed;           /* Where to start stealing           */
+    solver_t        sv;
+} worker_t;
+
+static struct pool_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  start;          /* A job started, or ...             */
+    pthread_cond_t  done;           /* .. all workers finished it        */
+    int             threads;        /* # workers, worker 0 being main    */
+    int             generation;     /* # jobs started                    */
+    int             running;        /* # threads still in the job        */
+    int             pending;        /* # tasks queued or being counted   */
+    int             idle;           /* # workers looking for a task      */
+    int             stop;           /* Limit reached: abandon the job    */
+    int             limit;
+    long long       total;          /* # solutions counted               */
+} pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static worker_t workers[MAX_THREADS];
+
+/* Add solutions to the total of the job, stopping it at the limit */
 static
 void
-el_init (edit_t *   ep,
-         int        edit_field_y,
-         int        edit_field_x,
-         char *     edit_buffer,
-         size_t     edit_buffer_size,
-         size_t     edit_field_size)
+add_total (int count)
 {
-    ep->eb          = edit_buffer;
-    ep->ebs         = edit_buffer_size;
-    ep->efs         = edit_field_size;
-    ep->efx         = edit_field_x;
-    ep->efy         = edit_field_y;
-    ep->ecn         = (int)(strlen(edit_buffer));
-    ep->ecp         = ep->ecn;
-    ep->x_0         = edit_field_x;
-    ep->x_1         = edit_field_x + 1;
-    ep->x_2         = (int)edit_field_size - 2;
-    ep->x_3         = ep->x_2 + 1;
-    ep->x_mv        = ep->x_2 - ep->x_1;
-    ep->m_0         = 0;
-    ep->m_1         = 0;
-    ep->prompt      = '$';
-    ep->dprompt     = '$';
-    ep->eol_mark    = '*';
-    ep->ins_mode    = 1;
-    ep->ch          = edit_buffer[0];
-
-    /* Find out what should be the prompt character. */
-    if (ep->ch == '>' ||
-        ep->ch == '|' ||
-        ep->ch == '%') {
-        /* Learn the prompt and set the minimal 
-         * index of the string buffer to 1.
-         */
-        ep->dprompt = ep->ch;
-        ep->m_0     = 1;
-        ep->m_1     = 1;
-    }
-    /* Calculate the visible part of the pathname. */
-    if (ep->x_mv < ep->ecn - ep->m_0) {
-        /* set the buffer position of the first visible character */
-        ep->m_1 = ep->ecn - ep->x_mv;
-    }
-
-    if (ep->m_1 > 1) {
-        /* give visual feedback about that there are more characters */
-        ep->prompt = '<';
-    } else {
-        /* set the default prompt */
-        ep->prompt = ep->dprompt;
+    if (__atomic_add_fetch(&pool.total, count, __ATOMIC_RELAXED)
+        >= pool.limit) {
+        __atomic_store_n(&pool.stop, 1, __ATOMIC_RELAXED);
     }
 }
 
-/* Functions to classify the actual character.
- * The ep pointer must point to a valid memory location.
- */
+/* Queue the board of the worker as a task; returns 0, or -1 if full */
 static
 int
-el_is_silent_ignore_char (edit_t *  ep)
+push_task (worker_t * w)
 {
-    return (VKEY_UP == ep->ch ||
-            VKEY_DOWN == ep->ch ||
-            VKEY_IGNORE == ep->ch);
-}
+    task_t * tp;
+    int ret = -1;
 
-static
-int
-el_is_loud_ignore_char (edit_t *    ep)
-{
-    return ('|' == ep->ch ||
-            '>' == ep->ch ||
-            '<' == ep->ch);
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom < DEQUE_SIZE) {
+        tp = &w->deque[w->bottom++];
+        memcpy(tp->board, w->sv.board, sizeof(tp->board));
+        memcpy(tp->used, w->sv.used, sizeof(tp->used));
+        tp->hash = w->sv.hash;
+        __atomic_add_fetch(&pool.pending, 1, __ATOMIC_SEQ_CST);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return ret;
 }
 
+/* Take a task from the worker 'from' into the solver of worker 'w';
+ * the owner takes the last task queued, thieves the first. Returns 0,
+ * or -1 if there was none.
+ */
 static
 int
-el_is_changeable_prompt_char (edit_t *  ep)
+take_task (worker_t * w, worker_t * from)
 {
-    return (('%' != ep->prompt &&
-             '$' != ep->prompt)
-            && ('|' == ep->ch ||
-                '>' == ep->ch));
+    const task_t * tp = 0;
+
+    pthread_mutex_lock(&from->lock);
+    if (from->top < from->bottom) {
+        tp = &from->deque[w == from ? --from->bottom : from->top++];
+        memcpy(w->sv.board, tp->board, sizeof(tp->board));
+        memcpy(w->sv.used, tp->used, sizeof(tp->used));
+        w->sv.hash = tp->hash;
+        w->sv.idx_history = 0;
+        if (from->top == from->bottom) {
+            from->top = from->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&from->lock);
+    return 0 == tp ? -1 : 0;
 }
 
-/* Functions to classify the actual cursor position.
- * The ep pointer must point to a valid memory location.
+/* Parallel counterpart of count_completions(). The solutions are added
+ * to the total of the job as they are found, so the job stops once at
+ * its limit. Returns the count below the board, or -1 if part of it was
+ * handed over or abandoned (and hence is not memoized).
  */
 static
 int
-el_is_cursor_at_rightmost_position (edit_t *   ep)
+count_task (worker_t * w)
 {
-    return (ep->ecp == ep->m_1 &&
-            ep->m_1 == 1);
-}
+    solver_t * sv = &w->sv;
+    int board[81], used[MAX_UNITS];
+    int idx_history, idx, digit, n, count = 0, complete = 1;
+    zkey_t hash;
 
-/* Functions to classify the actual cursor position.
- * The ep pointer must point to a valid memory location.
- */
-static
-void
-el_adjust_markers (edit_t *   ep)
-{
-    int first_invisible = ep->m_1 + ep->x_mv;
-    if (ep->m_0 == ep->m_1) {
-        /* The first visible is the first editable character. */
-        if (ep->prompt != ep->dprompt) {
-            /* Show the default prompt if it is not shown yet. */
-            ep->prompt = ep->dprompt;
-            mvaddch(ep->efy, ep->x_0, ep->prompt);
-        }
-    } else {
-        /* The first visible is not the first editable character. */
-        if (ep->prompt != '<') {
-            ep->prompt = '<';
-            /* Show the '<' prompt. */
-            mvaddch(ep->efy, ep->x_0, ep->prompt);
-        }
+    if (__atomic_load_n(&pool.stop, __ATOMIC_RELAXED)) {
+        return -1;
     }
-    if (ep->ecn > first_invisible) {
-        /* The last visible is not the last editable character. */
-        if (ep->eol_mark != '<') {
-            ep->eol_mark = '<';
-            mvaddch(ep->efy, ep->x_3, ep->eol_mark);
+    if (-1 == fill_singles(sv)) {
+        return 0;
+    }
+    idx = choice(sv);
+    if (-1 == idx) {
+        add_total(1);
+        return 1;
+    } else if (idx < 0) {
+        return 0;
+    }
+    if (TT_EXACT == tt_probe(sv->hash, &count)) {
+        add_total(count);
+        return count;
+    }
+    count = 0;
+
+    memcpy(board, sv->board, sizeof(board));
+    memcpy(used, sv->used, sizeof(used));
+    idx_history = sv->idx_history;
+    hash = sv->hash;
+    for (digit = 1; digit <= 9; ++digit) {
+        if (DISALLOWED(sv, idx, digit)) {
+            continue;
         }
-    } else {
-        if (ep->eol_mark != ' ') {
-            ep->eol_mark = ' ';
-            mvaddch(ep->efy, ep->x_3, ep->eol_mark);
+        sv->board[idx] = SET_DIGIT(digit);
+        update(sv, idx);
+        append_move(sv, idx, digit, CHOICE);
+        if (0 < __atomic_load_n(&pool.idle, __ATOMIC_RELAXED)
+            && 0 == push_task(w)) {
+            complete = 0;
+        } else if (0 <= (n = count_task(w))) {
+            count += n;
+        } else {
+            complete = 0;
         }
+
+        memcpy(sv->board, board, sizeof(board));
+        memcpy(sv->used, used, sizeof(used));
+        sv->idx_history = idx_history;
+        sv->hash = hash;
     }
+    if (!complete) {
+        return -1;
+    }
+    tt_store(hash, count, TT_EXACT);
+    return count;
 }
 
-/* Process change the prompt character.
- * The ep pointer must point to a valid memory location.
- */
+/* Count tasks until there are none left in the job */
 static
 void
-el_process_change_prompt (edit_t *  ep)
+run_worker (worker_t * w)
 {
-    /* change the prompt */
-    ep->dprompt = ep->ch;
-    ep->prompt = ep->dprompt;
-    /* Display the prompt character. */
-    mvaddch(ep->efy, ep->x_0, ep->prompt);
+    int i, n = pool.threads;
+
+    for (;;) {
+        if (-1 == take_task(w, w)) {
+            __atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+            w->seed = w->seed * 1103515245 + 12345;
+            for (i = 0; i < n; ++i) {
+                if (0 == take_task(w, &workers[(w->seed + i) % n])) {
+                    break;
+                }
+            }
+            __atomic_sub_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+            if (i == n) {
+                if (0 == __atomic_load_n(&pool.pending, __ATOMIC_SEQ_CST)) {
+                    return;
+                }
+                sched_yield();
+                continue;
+            }
+        }
+        count_task(w);
+        __atomic_sub_fetch(&pool.pending, 1, __ATOMIC_SEQ_CST);
+    }
 }
 
-/* Show the actual character.
- * The ep pointer must point to a valid memory location.
- */
 static
-void
-el_show_actual_char (edit_t *  ep)
+void *
+worker_main (void * arg)
 {
-    if (ep->m_0 <= ep->m_1 &&
-        ep->m_1 <= ep->ecp &&
-        ep->ecp <= ep->ecn) {
+    worker_t * w = (worker_t *)arg;
+    int generation = 0;
 
-        int first_invisible = ep->m_1 + ep->x_mv;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (generation == pool.generation) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        generation = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
 
-        if (ep->ecp < first_invisible) {
-            /* Display the character */
-            mvaddch(ep->efy,
-                    ep->ecp - ep->m_1 + ep->x_1,
-                    ep->eb[ep->ecp]);
-        } else {
-            if (ep->ecp != first_invisible ||
-                ep->eb[ep->ecp] != '\0') {
-                /* This should never happen. */
-                beep();
-            }
+        run_worker(w);
+
+        pthread_mutex_lock(&pool.lock);
+        if (0 == --pool.running) {
+            pthread_cond_signal(&pool.done);
         }
-    } else {
-        /* This should never happen. */
-        beep();
     }
+    return 0;
 }
 
-/* Highlight the actual character in overwrite mode.
- * The ep pointer must point to a valid memory location.
+/* Count the solutions to a given board like count_solutions(), with
+ * 'threads' workers (the calling thread being one of them), stopping
+ * once 'limit' have been found. The board is left untouched.
  */
 static
-void
-el_highlight_in_overwrite_mode (edit_t *    ep)
+int
+count_parallel (solver_t * sv, int limit, int threads)
 {
-    if (!ep->ins_mode) {
-        /* Overwrite mode, highlight the character at the current position. */
-        attron(A_BOLD);
-        el_show_actual_char(ep);
-        attroff(A_BOLD);
+    worker_t * w = &workers[0];
+    int i;
+
+    for (i = pool.threads; i < threads; ++i) {
+        pthread_mutex_init(&workers[i].lock, 0);
+        workers[i].seed = (unsigned int)i;
+        workers[i].sv.branching = bMRV;
+        if (0 < i && 0 != pthread_create(&workers[i].thread, 0,
+                                         worker_main, &workers[i])) {
+            break;
+        }
     }
-}
+    pool.threads = i;
 
-/* Remove the highlight at the current position in overwrite mode.
- * The ep pointer must point to a valid memory location.
- */
-static
-void
-el_remove_highlight_in_overwrite_mode (edit_t *    ep)
-{
-    if (!ep->ins_mode) {
-        /* Overwrite mode, remove the highlight at the current position. */
-        el_show_actual_char(ep);
+    for (i = 0; i < pool.threads; ++i) {
+        workers[i].sv.houses = sv->houses;
     }
-}
+    memcpy(w->sv.board, sv->board, sizeof(w->sv.board));
+    memcpy(w->sv.used, sv->used, sizeof(w->sv.used));
+    w->sv.hash = sv->hash;
+    push_task(w);
+    pool.total = 0;
+    pool.stop = 0;
+    pool.limit = limit;
 
-/* Show the actual character and highlight in overwrite mode.
- * The ep pointer must point to a valid memory location.
- */
-static
-void
-el_show_actual_char_with_highlight (edit_t *    ep)
-{
-    if (ep->ins_mode) {
-        /* Insert mode */
-        el_show_actual_char(ep);
-    } else {
-        /* Overwrite mode */
-        el_highlight_in_overwrite_mode(ep);
+    pthread_mutex_lock(&pool.lock);
+    ++pool.generation;
+    pool.running = pool.threads - 1;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_worker(w);
+
+    pthread_mutex_lock(&pool.lock);
+    while (0 < pool.running) {
+        pthread_cond_wait(&pool.done, &pool.lock);
     }
+    pthread_mutex_unlock(&pool.lock);
+    return pool.total < limit ? (int)pool.total : limit;
 }
+#endif
 
-/* Process toggle insert mode.
- * The ep pointer must point to a valid memory location.
+/* Build/modify internal representation from file
+ *
+ *  - lines starting with '#' are ignored
+ *  - puzzles start with a line beginning with '%' (with optional title)
+ *  - two formats are support: compact, verbose
+ *  - templates are always compact
+ *  - compact boards have no spaces or block separators
+ *  - verbose boards have spaces and block separators
+ *
+ * When is_tmplt is TRUE, a template is read.
+ *
+ * Return 0 on success; else -1 on error
  */
-static
-void
-el_process_toggle_insert_mode (edit_t *    ep)
+
+static char line[80];
+static char title[80];
+
+#define COMPACT  0
+#define VERBOSE  1
+
+/* Turn on the houses of the variants named in 'p' (separated by spaces
+ * or commas) for an empty board. Returns 0, or -1 for an unknown name.
+ */
+static
+int
+read_variant (solver_t * sv, const char * p)
 {
-    /* toggle insert mode. */
-    ep->ins_mode = !(ep->ins_mode);
-    el_show_actual_char_with_highlight(ep);
+    int i, n;
+
+    for (;;) {
+        while (*p && (isspace(*p) || ',' == *p)) {
+            ++p;
+        }
+        for (n = 0; p[n] && !isspace(p[n]) && ',' != p[n]; ++n) {
+            ;
+        }
+        if (0 == n) {
+            break;
+        }
+        for (i = 0; i < VARIANTS; ++i) {
+            if ((int)strlen(variant_name[i]) == n
+                && 0 == strncmp(variant_name[i], p, n)) {
+                break;
+            }
+        }
+        if (VARIANTS == i) {
+            return -1;
+        }
+        sv->houses |= variant_houses[i];
+        p += n;
+    }
+    sv->hash = houses_key(sv->houses);
+    return 0;
 }
 
-/* Process delete character at the current position.
- * The ep pointer must point to a valid memory location.
- */
 static
-void
-el_process_delete_ch_at_current_position (edit_t *    ep)
+int
+read_board (solver_t * sv, FILE * f, int is_tmplt)
 {
-    /* check if there is a character to delete at the current position */
-    if (ep->m_0 <= ep->ecp && ep->ecp < ep->ecn) {
-        /* delete character at the current position */
-        --ep->ecn;
-        if (ep->ecp < ep->ecn && ep->ecn > ep->m_0) {
-            int first_invisible = ep->m_1 + ep->x_mv;
-            int is_scroll_from_left = (ep->m_0 < ep->m_1 &&
-                                       ep->ecn < first_invisible);
-            /* The character is in middle of the string:
-             *  remove the character at the cursor from the buffer
-             */
-            memmove(&(ep->eb[ep->ecp]),
-                    &(ep->eb[ep->ecp + 1]),
-                    (ep->ecn - ep->ecp) + 1);
+    char * p, * q;
+    int i, row, col, type = COMPACT;
 
-            /* partial display of the right side
-             * scroll left if it is not the last character,
-             * or scroll right if it was the last
-             */
-            if (is_scroll_from_left) {
-                /* Decrease the left limit, show one more from left. */
-                --ep->m_1;
-                /* redisplay the left side */
-                if (ep->x_mv < ep->ecn - ep->m_1) {
-                    /* partial display of the right side */
-                    char che = ep->eb[ep->ecp];
-                    ep->eb[ep->ecp] = 0;
-                    mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
-                    ep->eb[ep->ecp] = che;
-                    el_show_actual_char(ep);
-                } else {
-                    mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
+    sv->houses = 0;
+    reset(sv);
+    len_tmplt = 0;
+
+    /* Skip lines until a '%' is found */
+    line[0] = ' ';
+    while ('%' != line[0]) {
+        if (0 == tgets(line, sizeof(line), f)) {
+            return -1;
+        }
+    }
+    /* Read optional title, and removing trailing whitespace */
+    for (p = line + 1; *p && isspace(*p); ++p) {
+       ;
+    }
+    if (*p) {
+        for (q = title; '\0' != (*q++ = *p++);) {
+           ;
+        }
+        --q;
+        while (isspace(*--q)) {
+           ;
+        }
+        *++q = '\0';
+    } else {
+        strcpy(title, "(untitled)");
+    }
+    /* Consume comment lines - no leading spaces allowed; '#variant'
+     * followed by the names of variants turns on their houses
+     */
+    line[0] = '#';
+    while ('#' == line[0]) {
+        if (0 == tgets(line, sizeof(line), f)) {
+            return -1;
+        }
+        if (0 == strncmp("#variant", line, 8)
+            && -1 == read_variant(sv, line + 8)) {
+            return -1;
+        }
+    }
+    /* Analyse first line to determine the 'type' - default is COMPACT */
+    if (0 == is_tmplt) {
+        for (p = line; *p && COMPACT == type; ++p) {
+            if ('|' == *p) {
+                type = VERBOSE;
+            }
+        }
+    }
+    /* Consume grid - allow leading spaces and comments at end */
+    for (row = 0; row < 9; ++row) {
+        /* Assume line already loaded into buffer; skip leading spaces */
+        for (p = line; *p && isspace(*p); ++p) {
+           ;
+        }
+        for (col = 0; *p && col < 9; ++col, ++p) {
+            if (is_tmplt) {
+                if ('*' == *p) {
+                    tmplt[len_tmplt++] = INDEX(row, col);
                 }
             } else {
-                /* redisplay the right side */
-                if (ep->x_mv < ep->ecn - ep->m_1) {
-                    /* partial display of the right side */
-                    int first_invisible = ep->m_1 + ep->x_mv;
-                    char che = ep->eb[first_invisible];
-                    ep->eb[first_invisible] = 0;
-
-                    mvaddstr(ep->efy,
-                             ep->ecp - ep->m_1 + ep->x_1,
-                             &(ep->eb[ep->ecp]));
-
-                    ep->eb[first_invisible] = che;
-                } else {
-                    mvaddstr(ep->efy,
-                             ep->ecp - ep->m_1 + ep->x_1,
-                             &(ep->eb[ep->ecp]));
+                if (VERBOSE == type) {
+                    while (*p && (isspace(*p) || '|' == *p)) {
+                        ++p;
+                    }
+                }
+                if (isdigit(*p)) {
+                    if (0 != fill(sv, INDEX(row, col), *p - '0')) {
+                        return -1;
+                    }
+                    sv->board[INDEX(row, col)] |= FIXED;
                 }
+                /* else assume blank square */
             }
-            /* Higliht the char in overwrite mode at the current position */
-            el_highlight_in_overwrite_mode(ep);
         }
-        ep->eb[ep->ecn] = '\0';
-        if (ep->x_mv > ep->ecn - ep->m_1) {
-            /* clear the deleted last character on the display */
-            mvaddch(ep->efy, ep->ecn - ep->m_1 + ep->x_1, ' ');
+        /* Don't complain about any trailing characters - ignored silently */
+
+        /* Load next line (if needed) */
+        if (row < 8) {
+            if (0 == tgets(line, sizeof(line), f)) {
+                return -1;
+            }
+            if (VERBOSE == type
+                && 2 == row % 3
+                && 0 == tgets(line, sizeof(line), f)) {
+                return -1; /* Skip separators */
+            }
         }
-        /* Make sure that the proper markers displayed. */
-        el_adjust_markers (ep);
-    } else {
-        beep();
     }
+
+    /* Construct move history for a template */
+    if (is_tmplt) {
+        sv->idx_history = 0;
+        for (i = 0; i < 81; ++i) {
+            if (0 != DIGIT(sv, i)) {
+                sv->history[sv->idx_history++] = i | (DIGIT(sv, i) << 8);
+            }
+        }
+    }
+    /* Finally, markup all of these moves as 'fixed' */
+    for (i = 0; i < sv->idx_history; ++i) {
+        sv->history[i] |= FIXED;
+    }
+    return 0;
 }
 
-/* Process delete character at the current position.
- * The ep pointer must point to a valid memory location.
+/* Batch propagation: up to BATCH boards are filled in at once, each in
+ * its own 16-bit lane, so that the digits allowed in a square of all
+ * of them fit in one AVX2 register. Each round masks the digits of the
+ * squares known in each unit (naked singles), then fills the digits
+ * with a single position left in a unit (hidden singles), in lock-step
+ * for every lane, until a round changes nothing. A board that ends
+ * with a digit in every square, each unit holding all 9 of them, has
+ * just that solution, as every step was forced; any other board (with
+ * a contradiction, or needing guesses) is left to the engines. Only
+ * the rows, columns and blocks are known here, so boards with houses
+ * turned on are never batched; nor is any board without AVX2.
  */
+#define BATCH                   16
+
+typedef unsigned short lanes_t[BATCH];
+
+#if defined (HAVE_AVX2)
+/* Check which lanes hold a solution; sets unique[] for the first 'n' */
 static
 void
-el_process_move_cursor_left_or_right (edit_t *    ep)
+batch_check (lanes_t * cand, int n, unsigned char * unique)
 {
-    if ((ep->m_0 < ep->ecp && VKEY_LEFT == ep->ch) ||
-        (ep->ecp < ep->ecn && VKEY_RIGHT == ep->ch)) {
-        /* Remove the highlight at the previous position if the removal is needed. */
-        int first_invisible = ep->m_1 + ep->x_mv;
-        el_remove_highlight_in_overwrite_mode(ep);
-        ep->ecp += (VKEY_RIGHT == ep->ch) - (VKEY_LEFT == ep->ch);
-        if (ep->ecp < ep->m_1
-            || ep->ecp > first_invisible
-            || (ep->ecp == first_invisible && ep->ecp != ep->ecn)) {
-            /* scroll right or left as needed */
-            ep->m_1 += (ep->ecp >= first_invisible) - (ep->ecp < ep->m_1);
-            first_invisible = ep->m_1 + ep->x_mv;
-            if (first_invisible < (int)ep->ebs) {
-                char chx = ep->eb[first_invisible];
-                ep->eb[first_invisible] = 0;
-                mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
-                ep->eb[first_invisible] = chx;
-            } else {
-                mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
+    int i, l, u, x, seen;
+
+    for (l = 0; l < n; ++l) {
+        unique[l] = 1;
+        for (u = 0; unique[l] && u < 27; ++u) {
+            for (seen = 0, i = 0; i < 9; ++i) {
+                x = cand[unit_cell[u][i]][l];
+                if (0 == x || 0 != (x & (x - 1))) {
+                    break;
+                }
+                seen |= x;
             }
+            unique[l] = 9 == i && 0x1ff == seen;
         }
-        /* Higliht the char in overwrite mode at the current position */
-        el_highlight_in_overwrite_mode(ep);
-        /* Make sure that the proper markers displayed. */
-        el_adjust_markers (ep);
-    } else {
-        beep();
     }
 }
 
-/* Process destructive backspace.
- * The ep pointer must point to a valid memory location.
- */
+/* Propagate singles in every lane until nothing changes */
+__attribute__((target("avx2")))
 static
 void
-el_process_destructive_backspace (edit_t *   ep)
+batch_propagate (lanes_t * cand)
 {
-    if (ep->m_0 < ep->ecp) {
-        int first_invisible = ep->m_1 + ep->x_mv;
-        int is_scroll_from_left = (ep->m_0 < ep->m_1);
-        assert(ep->ecn >= ep->ecp);
-        --ep->ecn;
-        --ep->ecp;
-        if (is_scroll_from_left) {
-            /* Decrease the left limit, show one more from left. */
-            --ep->m_1;
-            --first_invisible;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    __m256i v[9], single[9], known, once, twice, hidden, changed, x;
+    int u, i;
+
+    do {
+        changed = zero;
+        for (u = 0; u < 27; ++u) {
+            known = once = twice = zero;
+            for (i = 0; i < 9; ++i) {
+                v[i] = _mm256_loadu_si256((const __m256i *)
+                                          cand[unit_cell[u][i]]);
+                single[i] = _mm256_cmpeq_epi16(
+                    _mm256_and_si256(v[i], _mm256_sub_epi16(v[i], one)),
+                    zero);
+                known = _mm256_or_si256(known,
+                                        _mm256_and_si256(single[i], v[i]));
+            }
+            for (i = 0; i < 9; ++i) {
+                x = _mm256_blendv_epi8(_mm256_andnot_si256(known, v[i]),
+                                       v[i], single[i]);
+                twice = _mm256_or_si256(twice, _mm256_and_si256(once, x));
+                once = _mm256_or_si256(once, x);
+                changed = _mm256_or_si256(changed, _mm256_xor_si256(x, v[i]));
+                v[i] = x;
+            }
+            hidden = _mm256_andnot_si256(twice, once);
+            for (i = 0; i < 9; ++i) {
+                x = _mm256_and_si256(v[i], hidden);
+                x = _mm256_blendv_epi8(x, v[i], _mm256_cmpeq_epi16(x, zero));
+                changed = _mm256_or_si256(changed, _mm256_xor_si256(x, v[i]));
+                _mm256_storeu_si256((__m256i *)cand[unit_cell[u][i]], x);
+            }
         }
-        if (ep->ecp <= ep->ecn && ep->ecn > ep->m_0) {
-            /* Remove the deleted character. */
+    } while (!_mm256_testz_si256(changed, changed));
+}
+#endif
 
-            memmove(&(ep->eb[ep->ecp]),
-                    &(ep->eb[ep->ecp + 1]),
-                    (ep->ecn - ep->ecp) + 1);
+/* Find which of the 'n' (up to BATCH) boards given by the digits of
+ * their squares singles alone solve, in unique[]; the squares of those
+ * boards are filled in with their solution
+ */
+static
+void
+batch_singles (unsigned char (* cell)[81], int n, unsigned char * unique)
+{
+#if defined (HAVE_AVX2)
+    static lanes_t cand[81];
+    int i, l;
 
-            if (is_scroll_from_left ||
-                first_invisible < ep->ecn) {
-                /* There is still a hidden part on the right side.
-                 * Remove the highlight and show the modified string.
-                 */
-                if (is_scroll_from_left) {
-                    /* scroll from left, redraw the left side */
-                    char chk = ep->eb[ep->ecp];
-                    ep->eb[ep->ecp] = 0;
+    if (__builtin_cpu_supports("avx2")) {
+        for (i = 0; i < 81; ++i) {
+            for (l = 0; l < BATCH; ++l) {
+                cand[i][l] = (unsigned short)(l < n && 0 != cell[l][i]
+                                              ? 1 << (cell[l][i] - 1)
+                                              : 0x1ff);
+            }
+        }
+        batch_propagate(cand);
+        batch_check(cand, n, unique);
+        for (l = 0; l < n; ++l) {
+            for (i = 0; unique[l] && i < 81; ++i) {
+                cell[l][i] = (unsigned char)(1 + numset((cand[i][l] - 1)
+                                                        << (STATE_SHIFT + 1)));
+            }
+        }
+        return;
+    }
+#else
+    (void) cell;
+#endif
+    memset(unique, 0x00, n);
+}
 
+/* Boards read ahead by next_board(), with whether each is solved by
+ * singles alone
+ */
+typedef struct {
+    int             n;                  /* Number of boards read ahead */
+    int             next;               /* Next board to hand out */
+    int             eof;                /* Set once read_board() failed */
+    unsigned char   cell[BATCH][81];    /* Digits of the given squares */
+    char            title[BATCH][sizeof(title)];
+    int             houses[BATCH];
+    unsigned char   unique[BATCH];
+} batch_t;
+
+static batch_t batch;
+
+/* Load the board of the givens of 'cell', as read_board() would have */
+static
+void
+load_givens (solver_t * sv, const unsigned char * cell, int houses)
+{
+    int i;
+
+    sv->houses = houses;
+    reset(sv);
+    for (i = 0; i < 81; ++i) {
+        if (0 != cell[i]) {
+            fill(sv, i, cell[i]);
+            sv->board[i] |= FIXED;
+        }
+    }
+    for (i = 0; i < sv->idx_history; ++i) {
+        sv->history[i] |= FIXED;
+    }
+}
+
+/* Read the next precanned board into 'sv' and 'title', as read_board()
+ * does, but BATCH boards at a time so that the plain ones go through
+ * batch_singles() together; '*unique' is then set for a board singles
+ * alone solve, which needs no counting. Returns -1 after the last board.
+ */
+static
+int
+next_board (solver_t * sv, FILE * f, int * unique)
+{
+    static unsigned char plain[BATCH][81];
+    static unsigned char solved[BATCH];
+    static int lane[BATCH];
+    batch_t * b = &batch;
+    int i, k;
+
+    if (b->next == b->n) {
+        if (b->eof) {
+            return -1;
+        }
+        b->n = b->next = k = 0;
+        while (b->n < BATCH && 0 == read_board(sv, f, 0)) {
+            for (i = 0; i < 81; ++i) {
+                b->cell[b->n][i] = (unsigned char)DIGIT(sv, i);
+            }
+            strcpy(b->title[b->n], title);
+            b->houses[b->n] = sv->houses;
+            b->unique[b->n] = 0;
+            if (0 == sv->houses) {
+                memcpy(plain[k], b->cell[b->n], sizeof(plain[k]));
+                lane[k++] = b->n;
+            }
+            ++b->n;
+        }
+        b->eof = b->n < BATCH;
+        if (0 != k) {
+            batch_singles(plain, k, solved);
+            for (i = 0; i < k; ++i) {
+                b->unique[lane[i]] = solved[i];
+            }
+        }
+        if (0 == b->n) {
+            return -1;
+        }
+    }
+    load_givens(sv, b->cell[b->next], b->houses[b->next]);
+    strcpy(title, b->title[b->next]);
+    *unique = b->unique[b->next++];
+    return 0;
+}
+
+/**
+ **  Curses screen interface
+ **/
+
+/* Screen geometry */
+#define SUDOKU_LINE   2
+#define TITLE_LINE    4
+#define TOP           6
+#define LEFT_LEFT     0
+#define LEFT_MIDDLE  15
+#define LEFT         27
+#define SUDOKU_POS   35
+#define BOTTOM       (TOP+3*4)
+#define RIGHT        (LEFT+3*8)
+#define LINE_SIZE    80
+#define STATUS_LINE  20
+#define FILE_LINE    21
+#define LAST_LINE    23
+
+/* Maintain some global state - current cursor position */
+static int curx;
+static int cury;
+
+static int have_status;  /* True (non-zero) if status line set */
+static int have_hint;    /* True (non-zero) If hint displayed */
+
+static char statusline[LINE_SIZE];  /* Buffer for status line */
+
+/* Render board background - assume 24x80 screen */
+static
+void
+draw_screen (void)
+{
+    int i;
+
+    wclear(stdscr);
+    attron(A_BOLD);
+    mvaddstr(SUDOKU_LINE, SUDOKU_POS, "Su-Do-Ku!");
+    attroff(A_BOLD);
+
+    for (i = 0; i < 3; ++i) {
+        mvaddstr(TOP + 0 + 4 * i, LEFT, "+-------+-------+-------+");
+        mvaddstr(TOP + 1 + 4 * i, LEFT, "|       |       |       |");
+        mvaddstr(TOP + 2 + 4 * i, LEFT, "|       |       |       |");
+        mvaddstr(TOP + 3 + 4 * i, LEFT, "|       |       |       |");
+    }
+    mvaddstr(TOP + 4 * 3, LEFT, "+-------+-------+-------+");
+
+    mvaddstr(TOP + 2, LEFT_LEFT + 1, "Rules:");
+    mvaddstr(TOP + 3, LEFT_LEFT + 2, "Fill the grid so that");
+    mvaddstr(TOP + 4, LEFT_LEFT + 2, "every column, row and");
+    mvaddstr(TOP + 5, LEFT_LEFT + 2, "3x3 box contains each");
+    mvaddstr(TOP + 6, LEFT_LEFT + 2, "of the digits 1 to 9.");
+    i = TOP + 7;
+    if (0 == opt_restrict) {
+        mvaddstr(++i, LEFT_LEFT + 1, "File:");
+        mvaddstr(++i, LEFT_LEFT + 2, "s   save board");
+        mvaddstr(++i, LEFT_LEFT + 2, "w   write template");
+        mvaddstr(++i, LEFT_LEFT + 2, "o   open board");
+        mvaddstr(++i, LEFT_LEFT + 2, "t   set board title");
+    }
+
+/*    mvaddstr(TOP - 1, RIGHT + 4, "Keys:"); */
+    mvaddstr(TOP + 0, RIGHT + 8, "k");
+    mvaddstr(TOP + 1, RIGHT + 4, "  h   l move cursor");
+    mvaddstr(TOP + 2, RIGHT + 8, "j");
+    mvaddstr(TOP + 3, RIGHT + 7, "1-9  place digit");
+    mvaddstr(TOP + 4, RIGHT + 7, "0 .  clear digit");
+    mvaddstr(TOP + 5, RIGHT + 8, "c   clear board");
+    mvaddstr(TOP + 6, RIGHT + 8, "d   redraw the board");
+    mvaddstr(TOP + 7, RIGHT + 8, "f   fix squares");
+    mvaddstr(TOP + 8, RIGHT + 8, "n   new board");
+    mvaddstr(TOP + 9, RIGHT + 8, "q   quit game");
+    i = TOP + 9;
+    mvaddstr(++i, RIGHT + 8, "r   restart");
+    mvaddstr(++i, RIGHT + 8, "u   undo last move");
+    mvaddstr(++i, RIGHT + 8, "v   solve");
+    mvaddstr(++i, RIGHT + 8, "?   request hint");
+}
+
+/* Write board title */
+static
+void
+write_title(const char * title)
+{
+    move(TITLE_LINE, LEFT_LEFT);
+    wclrtoeol(stdscr);
+    if (0 != title) {
+        mvaddstr(TITLE_LINE,
+                 (int)((LINE_SIZE - strlen(title)) / 2),
+                 title);
+    }
+}
+
+/* Move cursor to grid position, and force refresh */
+static
+void
+move_to (int x, int y)
+{
+    curx = x;
+    cury = y;
+
+    move(TOP + 1 + y + y / 3,
+         LEFT + 2 + 2 * (x + x / 3));
+
+    wrefresh(stdscr);
+}
+
+/* Move cursor to next non-fixed square, and force refresh */
+void
+static
+move_next (void)
+{
+    solver_t * sv = &solver;
+    int is_loop = 0;
+    do {
+        if (curx < 8) {
+            move_to(curx + 1, cury);
+        } else if (cury < 8) {
+            move_to(0, cury + 1);
+        } else {
+            move_to(0, 0);
+            if (is_loop++ > 0) {
+                /* We can get here if the user attempts to load a fully
+                 * populated board. In that case it's better to break.  */
+                break;
+            }
+        }
+     } while (IS_FIXED(sv, INDEX(cury, curx)));
+}
+
+/* Render status line */
+static
+void
+set_status (const char * txt)
+{
+    mvaddstr(STATUS_LINE,
+             (int)((LINE_SIZE - strlen(txt)) / 2),
+             (char *)txt);
+
+    move_to(curx, cury);
+    wrefresh(stdscr);
+    have_status = 1;
+}
+
+static
+void
+clear_status (void)
+{
+    move(STATUS_LINE, LEFT_LEFT);
+    wclrtoeol(stdscr);
+    move_to(curx, cury);
+    have_status = 0;
+}
+
+/* Show meassge in the status line for 2 seconds */
+static
+void
+status_message (const char * txt)
+{
+    beep();
+    set_status(txt);
+    usleep(2000000);
+    clear_status();
+}
+
+/* Beep and show meassge in the status line for 2 seconds */
+static
+void
+beep_status_message (const char * txt)
+{
+    beep();
+    status_message(txt);
+}
+
+/* Render current board */
+static
+void
+render (void)
+{
+    solver_t * sv = &solver;
+    int i, x, y;
+
+    for (i = 0; i < 81; ++i) {
+        x = LEFT + 2 + 2 * (COLUMN(i) + COLUMN(i) / 3);
+        y = TOP + 1 + ROW(i) + ROW(i) / 3;
+        assert(0 <= DIGIT(sv, i));
+        assert(DIGIT(sv, i) <= 9); /* XXX FAILING */
+        if (IS_FIXED(sv, i)) {
+            attron(A_BOLD);
+        }
+        if (IS_EMPTY(sv, i)) {
+            mvaddch(y, x, '.');
+        } else {
+            mvaddch(y, x, '0' + DIGIT(sv, i));
+        }
+        if (IS_FIXED(sv, i)) {
+            attroff(A_BOLD);
+        }
+    }
+}
+
+static
+void
+row_hint (int row)
+{
+    mvaddch(TOP + 1 + row + row / 3, LEFT - 2, '>');
+    mvaddch(TOP + 1 + row + row / 3, RIGHT + 2, '<');
+    move_to(curx, cury);
+    have_hint = 1;
+}
+
+static
+void
+column_hint (int col)
+{
+    mvaddch(TOP - 1, LEFT + 2 + 2 * (col + col / 3), 'v');
+    mvaddch(BOTTOM + 1, LEFT + 2 + 2 * (col + col / 3), '^');
+    move_to(curx, cury);
+    have_hint = 1;
+}
+
+static
+void
+block_hint (int block)
+{
+    int i, j;
+    for (i = 0; i < 3; ++i) {
+        j = 3 * (block / 3) + i;
+        mvaddch(TOP + 1 + j + j / 3, LEFT - 2, '>');
+        mvaddch(TOP + 1 + j + j / 3, RIGHT + 2, '<');
+        j = 3 * (block % 3) + i;
+        mvaddch(TOP - 1, LEFT + 2 + 2 * (j + j / 3), 'v');
+        mvaddch(BOTTOM + 1, LEFT + 2 + 2 * (j + j / 3), '^');
+    }
+    move_to(curx, cury);
+    have_hint = 1;
+}
+
+static
+void
+clear_hints (void)
+{
+    int i;
+    for (i = 0; i < 9; ++i) {
+        mvaddch(TOP + 1 + i + i / 3, LEFT - 2, ' ');
+        mvaddch(TOP + 1 + i + i / 3, RIGHT + 2, ' ');
+        mvaddch(TOP - 1, LEFT + 2 + 2 * (i + i / 3), ' ');
+        mvaddch(BOTTOM + 1, LEFT + 2 + 2 * (i + i / 3), ' ');
+    }
+    have_hint = 0;
+    move_to(curx, cury);
+}
+
+/* Fix all squares - if possible.
+ * Returns -1 on error, in which case there is an error in the
+ * current board; otherwise returns 0 if all is OK.
+ */
+static
+int
+fix (void)
+{
+    solver_t * sv = &solver;
+    int i;
+
+    if (0 == reapply(sv)) {
+        compress(sv, sv->idx_history);
+        for (i = 0; i < sv->idx_history; ++i) {
+            sv->history[i] |= FIXED;
+        }
+        reapply(sv);
+        render();
+        if (sv->idx_history < 81 && IS_FIXED(sv, INDEX(cury, curx))) {
+            move_next();
+        } else {
+            move_to(curx, cury);
+        }
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+/* Limit factor definitions for the classification. */
+#define LIMIT_FACTOR_VERY_EASY  15
+#define LIMIT_FACTOR_EASY       11
+#define LIMIT_FACTOR_MEDIUM     7
+#define LIMIT_FACTOR_HARD       4
+#define LIMIT_FACTOR_FIENDISH   0
+
+static const char *     NAME_VERY_EASY  = "very easy";
+static const char *     NAME_EASY       = "easy";
+static const char *     NAME_MEDIUM     = "medium";
+static const char *     NAME_HARD       = "hard";
+static const char *     NAME_FIENDISH   = "fiendish";
+
+/* Class limit and name for the classification. */
+#define CL(ct)   ((LIMIT_FACTOR_##ct) * pass)
+#define CN(ct)    NAME_##ct
+
+static
+const char *
+class_name_by_score (int score, int pass)
+{
+    const char * name;
+    if (CL(VERY_EASY) < score) {
+        name = CN(VERY_EASY);
+    } else if (CL(EASY) < score) {
+        name = CN(EASY);
+    } else if (CL(MEDIUM) < score) {
+        name = CN(MEDIUM);
+    } else if (CL(HARD) < score) {
+        name = CN(HARD);
+    } else {
+        name = CN(FIENDISH);
+    }
+    return name;
+}
+
+/* Classify a SuDoKu, given its solution.
+ *
+ * The classification is based on the average number of possible moves
+ * for each pass of the deterministic solver - it is a rather simplistic
+ * measure, but gives reasonable results. Note also that the classification
+ * is based on the first solution found (but does handle the pathological
+ * case of multiple solutions). Note that the average moves per pass
+ * depends just on the number of squares initially set... this simplifies
+ * the statistics collection immensely, requiring just the number of passes
+ * to be counted.
+ *
+ * Return 0 on error, else a string classification.
+ */
+
+static
+const char *
+classify (solver_t * sv)
+{
+    int i, score, strategies = sv->strategies;
+    enum branch_enum branching = sv->branching;
+
+    /* Grade with the classic strategies only, to keep the scale stable */
+    sv->strategies = 0;
+    sv->branching = bMRV;
+    sv->pass = 0;
+    clear_moves(sv);
+    i = solve(sv);
+    sv->strategies = strategies;
+    sv->branching = branching;
+    if (-1 == i) {
+        return 0;
+    }
+
+    score = 81;
+    for (i = 0; i < 81; ++i) {
+        if (IS_FIXED(sv, i)) {
+            --score;
+        }
+    }
+    assert(81 == sv->idx_history);
+
+    for (i = 0; i < 81; ++i) {
+        if (sv->history[i] & CHOICE) {
+            score -= 5;
+        }
+    }
+    return  class_name_by_score(score, sv->pass);
+}
+
+/* exchange disjoint, identical length blocks of data */
+static
+void
+exchange (int * a, int * b, int len)
+{
+    int i, tmp;
+    for (i = 0; i < len; ++i) {
+        tmp = a[i];
+        a[i] = b[i];
+        b[i] = tmp;
+    }
+}
+
+/* rotate left */
+static
+void
+rotate1_left (int * a, int len)
+{
+    int i, tmp;
+    tmp = a[0];
+    for (i = 1; i < len; ++i) {
+        a[i - 1] = a[i];
+    }
+    a[len - 1] = tmp;
+}
+
+/* rotate right */
+static
+void
+rotate1_right (int * a, int len)
+{
+    int i, tmp;
+    tmp = a[len - 1];
+    for (i = len - 1; 0 < i; --i) {
+        a[i] = a[i - 1];
+    }
+    a[0] = tmp;
+}
+
+/* Generalised left rotation - there is a naturally recursive
+ * solution that is best implementation using iteration.
+ * Note that it is not necessary to do repeated unit rotations.
+ *
+ * This function is analogous to 'cutting' a 'pack of cards'.
+ *
+ * On entry: 0 < idx < len
+ */
+static
+void
+rotate (int * a, int len, int idx)
+{
+    int xdi = len - idx;
+    int delta = idx - xdi;
+
+    while (0 != delta && 0 != idx) {
+        if (delta < 0) {
+            if (1 == idx) {
+                rotate1_left(a, len);
+                idx = 0;
+            } else {
+                exchange(a, a + xdi, idx);
+                len = xdi;
+            }
+        } else {
+            /* 0 < delta */
+            if (1 == xdi) {
+                rotate1_right(a, len);
+                idx = 0;
+            } else {
+                exchange(a, a + idx, xdi);
+                a += xdi;
+                len = idx;
+                idx -= xdi;
+            }
+        }
+        xdi = len - idx;
+        delta = idx - xdi;
+    }
+    if (0 < idx) {
+        exchange(a, a + idx, idx);
+    }
+}
+
+/* Generating boards on several threads (-g -j) draws the random numbers
+ * of each board from a stream of its own, and works on a copy of the
+ * template; one thread at a time reads the template file.
+ */
+typedef struct gen_s {
+    rng_t   rng;                    /* Random stream of the board        */
+    int     tmplt[81];              /* Template indices                  */
+    int     len_tmplt;
+    char    title[80];
+} gen_t;
+
+#if defined (HAVE_THREADS)
+static pthread_mutex_t tmplt_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Random number in 0 .. n-1 from the stream of 'g', or rng if 0 */
+static
+int
+gen_below (gen_t * g, int n)
+{
+    return rng_below(0 != g ? &g->rng : &rng, n);
+}
+
+/* Shuffle an array of integers, with the random numbers of 'g' */
+static
+void
+shuffle (int * a, int len, gen_t * g)
+{
+    int i, j, tmp;
+
+    i = len;
+    while (1 <= i) {
+        j = gen_below(g, i);
+        tmp = a[--i];
+        a[i] = a[j];
+        a[j] = tmp;
+    }
+}
+
+/* Generate a SuDoKu puzzle
+ *
+ * The generation process selects a random template, and then attempts
+ * to fill in the exposed squares to generate a board. The order of the
+ * digits and of filling in the exposed squares are random.
+ */
+
+/* Select random template; sets tmplt, len_tmplt, or those of 'g' */
+static
+void
+select_template (solver_t * sv, gen_t * g)
+{
+    int i = n_tmplt > 0 ? gen_below(g, n_tmplt) : 0;
+#if defined (HAVE_THREADS)
+    if (0 != g) {
+        pthread_mutex_lock(&tmplt_lock);
+    }
+#endif
+    tseek(ftmplt, 0, SEEK_SET);
+    while (0 <= i && 0 == read_board(sv, ftmplt, 1)) {
+        --i;
+    }
+    if (0 != g) {
+        memcpy(g->tmplt, tmplt, sizeof(g->tmplt));
+        g->len_tmplt = len_tmplt;
+#if defined (HAVE_THREADS)
+        pthread_mutex_unlock(&tmplt_lock);
+#endif
+    }
+}
+
+/* The Luby sequence 1, 1, 2, 1, 1, 2, 4, 1, 1, 2, ... for i = 1, 2, ... */
+static
+int
+luby (int i)
+{
+    int k;
+
+    for (;;) {
+        for (k = 1; (1 << k) - 1 < i; ++k) {
+            ;
+        }
+        if ((1 << k) - 1 == i) {
+            return 1 << (k - 1);
+        }
+        i -= (1 << (k - 1)) - 1;
+    }
+}
+
+/* Have guesses try the digits in a random order, a permutation drawn
+ * with the random numbers of 'g'
+ */
+static
+void
+order_digits (solver_t * sv, gen_t * g)
+{
+    int order[9];
+    int i;
+
+    for (i = 0; i < 9; ++i) {
+        order[i] = i + 1;
+    }
+    shuffle(order, 9, g);
+    for (i = 0; i < 9; ++i) {
+        sv->rank_shift[i + 1] = (unsigned char)((order[i] + 8 - i) % 9);
+        sv->digit_shift[order[i]] = (unsigned char)((i + 10 - order[i]) % 9);
+    }
+}
+
+/* Generate a board in 'sv', titled in title; or, with 'g', with its
+ * random numbers, template and title (c.f. gen_t)
+ */
+static
+void
+generate (solver_t * sv, gen_t * g)
+{
+    int digits[9];
+    int * cells = 0 != g ? g->tmplt : tmplt;
+    int * len = 0 != g ? &g->len_tmplt : &len_tmplt;
+    char * name = 0 != g ? g->title : title;
+    int i, attempt = 0;
+
+    for (;;) {
+        for (i = 0; i < 9; ++i) {
+            digits[i] = i + 1;
+        }
+
+        rotate(digits, 9, 1 + gen_below(g, 8));
+        shuffle(digits, 9, g);
+        select_template(sv, g);
+
+        rotate(cells, *len, 1 + gen_below(g, *len - 1));
+        shuffle(cells, *len, g);
+
+        reset(sv);  /* construct a new board */
+
+        for (i = 0; i < *len; ++i) {
+            fill(sv, cells[i], digits[i % 9]);
+        }
+
+        /* With restarts, give up early on an attempt that needs many
+         * guesses, and try the digits in a random order for each.
+         */
+        if (0 != opt_restarts) {
+            order_digits(sv, g);
+            sv->guesses = 0;
+            sv->budget = opt_restarts * luby(++attempt);
+        }
+        i = engine_solve(sv);
+        memset(sv->rank_shift, 0x00, sizeof(sv->rank_shift));
+        memset(sv->digit_shift, 0x00, sizeof(sv->digit_shift));
+        sv->budget = 0;
+        if (0 != i || sv->idx_history < 81) {
+            continue;
+        }
+        for (i = 0; i < *len; ++i) {
+            sv->board[cells[i]] |= FIXED;
+        }
+        /* Construct fixed squares */
+        for (sv->idx_history = i = 0; i < 81; ++i) {
+            if (IS_FIXED(sv, i)) {
+                sv->history[sv->idx_history++] = SET_INDEX(i)
+                                                 | SET_DIGIT(DIGIT(sv, i))
+                                                 | FIXED;
+            }
+        }
+        clear_moves(sv);
+
+        if (1 != count_solutions(sv, 2)) {
+            continue;
+        }
+        if (NULL != requested_class) {
+            const char * generated_class = classify(sv);
+            sprintf(name, "randomly generated - %s", generated_class);
+            if (0 == g) {
+                write_title(name);
+                wrefresh(stdscr);
+            }
+            if (0 != strcmp(requested_class, generated_class)) {
+                continue;
+            }
+        }
+
+        break;
+    }
+
+    strcpy(name, "randomly generated - ");
+    strcat(name, classify(sv));
+
+    clear_moves(sv);
+    if (0 == g) {
+        time(&start_time);
+    }
+}
+
+#if defined (HAVE_THREADS)
+/* Generating boards on several threads (-g -j): each thread takes the
+ * number of the next board to generate, and generates it with its own
+ * solver context, and the random stream of that number (c.f. rng_t),
+ * into a ring of slots. The main thread prints the slots in order.
+ */
+#define GEN_SLOTS               (4 * MAX_THREADS)
+
+typedef struct gen_slot_s {
+    int             done;
+    int             houses;
+    int             board[81];
+    char            title[80];
+} gen_slot_t;
+
+typedef struct gen_thread_s {
+    pthread_t       thread;
+    solver_t        sv;
+    gen_t           gen;
+} gen_thread_t;
+
+static struct gens_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  free;           /* A slot was printed                */
+    pthread_cond_t  done;           /* A board was generated             */
+    int             taken;          /* # boards taken by threads         */
+    int             printed;        /* # boards printed                  */
+    int             total;          /* # boards to generate              */
+} gens = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, 0, 0, 0
+};
+
+static gen_slot_t gen_slot[GEN_SLOTS];
+static gen_thread_t gen_thread[MAX_THREADS];
+
+/* Generating thread: generate boards until there are no more to take */
+static
+void *
+gen_main (void * arg)
+{
+    gen_thread_t * t = (gen_thread_t *)arg;
+    gen_slot_t * slot;
+    int k;
+
+    for (;;) {
+        pthread_mutex_lock(&gens.lock);
+        while (gens.taken < gens.total
+               && gens.printed + GEN_SLOTS <= gens.taken) {
+            pthread_cond_wait(&gens.free, &gens.lock);
+        }
+        if (gens.total <= gens.taken) {
+            pthread_mutex_unlock(&gens.lock);
+            return 0;
+        }
+        k = gens.taken++;
+        pthread_mutex_unlock(&gens.lock);
+
+        rng_seed(&t->gen.rng, (zkey_t)(opt_first + k));
+        generate(&t->sv, &t->gen);
+        slot = &gen_slot[k % GEN_SLOTS];
+        memcpy(slot->board, t->sv.board, sizeof(slot->board));
+        slot->houses = t->sv.houses;
+        strcpy(slot->title, t->gen.title);
+
+        pthread_mutex_lock(&gens.lock);
+        slot->done = 1;
+        pthread_cond_broadcast(&gens.done);
+        pthread_mutex_unlock(&gens.lock);
+    }
+}
+
+/* Generate and print 'total' boards with 'threads' threads. Returns 0,
+ * or -1 if no thread could be started (nothing was generated).
+ */
+static
+int
+gen_parallel (solver_t * sv, int total, int threads)
+{
+    gen_slot_t * slot;
+    int i;
+
+    gens.total = total;
+    for (i = 0; i < threads; ++i) {
+        gen_thread[i].sv.engine = sv->engine;
+        gen_thread[i].sv.branching = sv->branching;
+        gen_thread[i].sv.strategies = sv->strategies;
+        if (0 != pthread_create(&gen_thread[i].thread, 0,
+                                gen_main, &gen_thread[i])) {
+            break;
+        }
+    }
+    threads = i;
+    if (0 == threads) {
+        return -1;
+    }
+
+    for (; gens.printed < total; ) {
+        slot = &gen_slot[gens.printed % GEN_SLOTS];
+        pthread_mutex_lock(&gens.lock);
+        while (!slot->done) {
+            pthread_cond_wait(&gens.done, &gens.lock);
+        }
+        pthread_mutex_unlock(&gens.lock);
+
+        memcpy(sv->board, slot->board, sizeof(sv->board));
+        sv->houses = slot->houses;
+        print(sv, stdout, slot->title);
+
+        pthread_mutex_lock(&gens.lock);
+        slot->done = 0;
+        ++gens.printed;
+        pthread_cond_broadcast(&gens.free);
+        pthread_mutex_unlock(&gens.lock);
+    }
+
+    for (i = 0; i < threads; ++i) {
+        pthread_join(gen_thread[i].thread, 0);
+    }
+    return 0;
+}
+#endif
+
+/* Support for explicitly opened board */
+static FILE * opened;
+
+/* Support for precanned board (optional) */
+static FILE * precanned;
+static int n_precanned;
+static int completed;
+
+static
+int
+open_precanned (const char * filename)
+{
+    solver_t * sv = &solver;
+    n_precanned = 0;
+    precanned = fopen(filename, "r");
+    if (0 != precanned) {
+        while (0 == read_board(sv, precanned, 0)) {
+            ++n_precanned;
+        }
+    }
+    /* return 0 on success, -1 on failure. */
+    return (n_precanned > 0) - 1;
+}
+
+static
+void
+open_template (const char * filename)
+{
+    solver_t * sv = &solver;
+    n_tmplt = 0;
+    ftmplt = topen(filename, "r");
+    if (0 != ftmplt) {
+        while (0 == read_board(sv, ftmplt, 1)) {
+            ++n_tmplt;
+        }
+    }
+}
+
+static
+int
+is_complete (const solver_t * sv)
+{
+    int i;
+    for (i = 0; i < 81 && !IS_EMPTY(sv, i); ++i) {
+        /* counting the non-empty squares. */
+    }
+   return (81 == i);
+}
+
+/* load a new board - this could be a precanned board,
+ * or a randomly generated board - chose between these
+ * randomly -- 1 in 3 chance of loading a precanned
+ * board (if they exist).
+ */
+static
+void
+load_board (void)
+{
+    solver_t * sv = &solver;
+    int i = 0;
+    if (opened) {
+        /* Select next board */
+        i = read_board(sv, opened, 0);
+        if (i--) {
+            fclose(opened);
+            opened = NULL;
+        }
+    } else if (precanned &&
+               (0 == opt_random ||
+                (0 == rng_below(&rng, 3) && 0 < n_precanned))) {
+        /* Select random board */
+        i = rng_below(&rng, n_precanned);
+        fseek(precanned, 0, SEEK_SET);
+        while (0 <= i && 0 == read_board(sv, precanned, 0)) {
+            --i;
+        }
+    }
+    if (i != -1) {
+        set_status("generating a random board... (please wait)");
+        generate(sv, 0);
+        clear_status();
+    }
+
+    /* Shameless plug... */
+    set_status("Su-Do-Ku by Michael Kennett");
+
+    render();
+    write_title(title);
+
+    curx = cury = 8;    /* move_next() takes care of this... */
+    move_next();
+    completed = is_complete(sv);
+    num_hints = -1;
+    time(&start_time);
+}
+
+/* Manage rich text input (define 'virtual' key codes)
+ * See the console(4) manpage.
+ */
+
+#define VKEY_IGNORE     (256)
+#define VKEY_UP         (256+'A')
+#define VKEY_DOWN       (256+'B')
+#define VKEY_RIGHT      (256+'C')
+#define VKEY_LEFT       (256+'D')
+#define VKEY_HOME       (256+'H')
+#define VKEY_INSERT     (256+'2')
+#define VKEY_DELETE     (256+'3')
+#define VKEY_END        (256+'4')
+#define VKEY_PGUP       (256+'5')
+#define VKEY_PGDOWN     (256+'6')
+#define VKEY_BACK       (0x08)
+
+
+static
+int
+getkey (void)
+{
+    int ch = wgetch(stdscr);
+    if (0x1b == ch) {
+        ch = wgetch(stdscr);
+        if ('[' == ch) {
+            ch = wgetch(stdscr);
+            switch (ch) {
+                case 'A': ch = VKEY_UP;     break;
+                case 'B': ch = VKEY_DOWN;   break;
+                case 'C': ch = VKEY_RIGHT;  break;
+                case 'D': ch = VKEY_LEFT;   break;
+                case 'H': ch = VKEY_HOME;   break;
+                case '2': ch = VKEY_INSERT; break;
+                case '3': ch = VKEY_DELETE; break;
+                case '4': ch = VKEY_END;    break;
+                case '5': ch = VKEY_PGUP;   break;
+                case '6': ch = VKEY_PGDOWN; break;
+                default:  ch = VKEY_IGNORE;
+            }
+            if (ch == VKEY_HOME ||
+                ch == VKEY_DELETE ||
+                ch == VKEY_INSERT ||
+                ch == VKEY_END ||
+                ch == VKEY_PGUP ||
+                ch == VKEY_PGDOWN) {
+                int ch4 = wgetch(stdscr);
+                if (ch4 != '~') {
+                    ch = VKEY_IGNORE;
+                }
+            }
+        } else {
+            /* Enabling the Esc Esc sequence to produce one Esc character */
+            if (0x1b != ch) {
+                ch = VKEY_IGNORE;
+            }
+        }
+    }
+    return ch;
+}
+
+/* Save board representation - the difficulty is managing the user interface
+ * (i.e. finding where to save), with a tad more work involved in allowing
+ * the board to be written to an arbitrary process.
+ *
+ * Persist the user filename.
+ */
+#if !defined (PATH_MAX)
+/* If it is not defined by the operating system, we can safely define it,
+ * since the code below has no strong dependence on the current working
+ * directory, for which it is solely used. */
+#define PATH_MAX 1024
+#endif
+
+static char userfile[PATH_MAX];
+static char templatefile[PATH_MAX];
+
+typedef struct edit_s {
+    char *  eb;         /* edit buffer                                  */
+    size_t  ebs;        /* edit buffer size                             */
+    size_t  efs;        /* edit field horizontal size                   */
+    int     efx;        /* edit field horizontal position               */
+    int     efy;        /* edit field vertical position                 */
+    int     ecn;        /* actual number of characters (including '\0') */
+    int     ecp;        /* edit position in the buffer                  */
+    int     x_0;        /* prompt position on the display               */
+    int     x_1;        /* first text position on the display           */
+    int     x_2;        /* last txt position on display                 */
+    int     x_3;        /* continuation marker position on display      */
+    int     x_mv;       /* maximal number of visible chars on display   */
+    int     m_0;        /* first editable char position in the buffer   */
+    int     m_1;        /* first visible char position in the buffer    */
+    int     prompt;     /* currently displayed prompt character         */
+    int     dprompt;    /* default prompt character                     */
+    int     eol_mark;   /* line continuation marker                     */
+    int     ins_mode;   /* insert mode                                  */
+    int     ch;         /* actual character for processing              */
+} edit_t;
+
+
+/* Init edit text data.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_init (edit_t *   ep,
+         int        edit_field_y,
+         int        edit_field_x,
+         char *     edit_buffer,
+         size_t     edit_buffer_size,
+         size_t     edit_field_size)
+{
+    ep->eb          = edit_buffer;
+    ep->ebs         = edit_buffer_size;
+    ep->efs         = edit_field_size;
+    ep->efx         = edit_field_x;
+    ep->efy         = edit_field_y;
+    ep->ecn         = (int)(strlen(edit_buffer));
+    ep->ecp         = ep->ecn;
+    ep->x_0         = edit_field_x;
+    ep->x_1         = edit_field_x + 1;
+    ep->x_2         = (int)edit_field_size - 2;
+    ep->x_3         = ep->x_2 + 1;
+    ep->x_mv        = ep->x_2 - ep->x_1;
+    ep->m_0         = 0;
+    ep->m_1         = 0;
+    ep->prompt      = '$';
+    ep->dprompt     = '$';
+    ep->eol_mark    = '*';
+    ep->ins_mode    = 1;
+    ep->ch          = edit_buffer[0];
+
+    /* Find out what should be the prompt character. */
+    if (ep->ch == '>' ||
+        ep->ch == '|' ||
+        ep->ch == '%') {
+        /* Learn the prompt and set the minimal 
+         * index of the string buffer to 1.
+         */
+        ep->dprompt = ep->ch;
+        ep->m_0     = 1;
+        ep->m_1     = 1;
+    }
+    /* Calculate the visible part of the pathname. */
+    if (ep->x_mv < ep->ecn - ep->m_0) {
+        /* set the buffer position of the first visible character */
+        ep->m_1 = ep->ecn - ep->x_mv;
+    }
+
+    if (ep->m_1 > 1) {
+        /* give visual feedback about that there are more characters */
+        ep->prompt = '<';
+    } else {
+        /* set the default prompt */
+        ep->prompt = ep->dprompt;
+    }
+}
+
+/* Functions to classify the actual character.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+int
+el_is_silent_ignore_char (edit_t *  ep)
+{
+    return (VKEY_UP == ep->ch ||
+            VKEY_DOWN == ep->ch ||
+            VKEY_IGNORE == ep->ch);
+}
+
+static
+int
+el_is_loud_ignore_char (edit_t *    ep)
+{
+    return ('|' == ep->ch ||
+            '>' == ep->ch ||
+            '<' == ep->ch);
+}
+
+static
+int
+el_is_changeable_prompt_char (edit_t *  ep)
+{
+    return (('%' != ep->prompt &&
+             '$' != ep->prompt)
+            && ('|' == ep->ch ||
+                '>' == ep->ch));
+}
+
+/* Functions to classify the actual cursor position.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+int
+el_is_cursor_at_rightmost_position (edit_t *   ep)
+{
+    return (ep->ecp == ep->m_1 &&
+            ep->m_1 == 1);
+}
+
+/* Functions to classify the actual cursor position.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_adjust_markers (edit_t *   ep)
+{
+    int first_invisible = ep->m_1 + ep->x_mv;
+    if (ep->m_0 == ep->m_1) {
+        /* The first visible is the first editable character. */
+        if (ep->prompt != ep->dprompt) {
+            /* Show the default prompt if it is not shown yet. */
+            ep->prompt = ep->dprompt;
+            mvaddch(ep->efy, ep->x_0, ep->prompt);
+        }
+    } else {
+        /* The first visible is not the first editable character. */
+        if (ep->prompt != '<') {
+            ep->prompt = '<';
+            /* Show the '<' prompt. */
+            mvaddch(ep->efy, ep->x_0, ep->prompt);
+        }
+    }
+    if (ep->ecn > first_invisible) {
+        /* The last visible is not the last editable character. */
+        if (ep->eol_mark != '<') {
+            ep->eol_mark = '<';
+            mvaddch(ep->efy, ep->x_3, ep->eol_mark);
+        }
+    } else {
+        if (ep->eol_mark != ' ') {
+            ep->eol_mark = ' ';
+            mvaddch(ep->efy, ep->x_3, ep->eol_mark);
+        }
+    }
+}
+
+/* Process change the prompt character.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_process_change_prompt (edit_t *  ep)
+{
+    /* change the prompt */
+    ep->dprompt = ep->ch;
+    ep->prompt = ep->dprompt;
+    /* Display the prompt character. */
+    mvaddch(ep->efy, ep->x_0, ep->prompt);
+}
+
+/* Show the actual character.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_show_actual_char (edit_t *  ep)
+{
+    if (ep->m_0 <= ep->m_1 &&
+        ep->m_1 <= ep->ecp &&
+        ep->ecp <= ep->ecn) {
+
+        int first_invisible = ep->m_1 + ep->x_mv;
+
+        if (ep->ecp < first_invisible) {
+            /* Display the character */
+            mvaddch(ep->efy,
+                    ep->ecp - ep->m_1 + ep->x_1,
+                    ep->eb[ep->ecp]);
+        } else {
+            if (ep->ecp != first_invisible ||
+                ep->eb[ep->ecp] != '\0') {
+                /* This should never happen. */
+                beep();
+            }
+        }
+    } else {
+        /* This should never happen. */
+        beep();
+    }
+}
+
+/* Highlight the actual character in overwrite mode.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_highlight_in_overwrite_mode (edit_t *    ep)
+{
+    if (!ep->ins_mode) {
+        /* Overwrite mode, highlight the character at the current position. */
+        attron(A_BOLD);
+        el_show_actual_char(ep);
+        attroff(A_BOLD);
+    }
+}
+
+/* Remove the highlight at the current position in overwrite mode.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_remove_highlight_in_overwrite_mode (edit_t *    ep)
+{
+    if (!ep->ins_mode) {
+        /* Overwrite mode, remove the highlight at the current position. */
+        el_show_actual_char(ep);
+    }
+}
+
+/* Show the actual character and highlight in overwrite mode.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_show_actual_char_with_highlight (edit_t *    ep)
+{
+    if (ep->ins_mode) {
+        /* Insert mode */
+        el_show_actual_char(ep);
+    } else {
+        /* Overwrite mode */
+        el_highlight_in_overwrite_mode(ep);
+    }
+}
+
+/* Process toggle insert mode.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_process_toggle_insert_mode (edit_t *    ep)
+{
+    /* toggle insert mode. */
+    ep->ins_mode = !(ep->ins_mode);
+    el_show_actual_char_with_highlight(ep);
+}
+
+/* Process delete character at the current position.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_process_delete_ch_at_current_position (edit_t *    ep)
+{
+    /* check if there is a character to delete at the current position */
+    if (ep->m_0 <= ep->ecp && ep->ecp < ep->ecn) {
+        /* delete character at the current position */
+        --ep->ecn;
+        if (ep->ecp < ep->ecn && ep->ecn > ep->m_0) {
+            int first_invisible = ep->m_1 + ep->x_mv;
+            int is_scroll_from_left = (ep->m_0 < ep->m_1 &&
+                                       ep->ecn < first_invisible);
+            /* The character is in middle of the string:
+             *  remove the character at the cursor from the buffer
+             */
+            memmove(&(ep->eb[ep->ecp]),
+                    &(ep->eb[ep->ecp + 1]),
+                    (ep->ecn - ep->ecp) + 1);
+
+            /* partial display of the right side
+             * scroll left if it is not the last character,
+             * or scroll right if it was the last
+             */
+            if (is_scroll_from_left) {
+                /* Decrease the left limit, show one more from left. */
+                --ep->m_1;
+                /* redisplay the left side */
+                if (ep->x_mv < ep->ecn - ep->m_1) {
+                    /* partial display of the right side */
+                    char che = ep->eb[ep->ecp];
+                    ep->eb[ep->ecp] = 0;
+                    mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
+                    ep->eb[ep->ecp] = che;
+                    el_show_actual_char(ep);
+                } else {
+                    mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
+                }
+            } else {
+                /* redisplay the right side */
+                if (ep->x_mv < ep->ecn - ep->m_1) {
+                    /* partial display of the right side */
+                    int first_invisible = ep->m_1 + ep->x_mv;
+                    char che = ep->eb[first_invisible];
+                    ep->eb[first_invisible] = 0;
+
+                    mvaddstr(ep->efy,
+                             ep->ecp - ep->m_1 + ep->x_1,
+                             &(ep->eb[ep->ecp]));
+
+                    ep->eb[first_invisible] = che;
+                } else {
+                    mvaddstr(ep->efy,
+                             ep->ecp - ep->m_1 + ep->x_1,
+                             &(ep->eb[ep->ecp]));
+                }
+            }
+            /* Higliht the char in overwrite mode at the current position */
+            el_highlight_in_overwrite_mode(ep);
+        }
+        ep->eb[ep->ecn] = '\0';
+        if (ep->x_mv > ep->ecn - ep->m_1) {
+            /* clear the deleted last character on the display */
+            mvaddch(ep->efy, ep->ecn - ep->m_1 + ep->x_1, ' ');
+        }
+        /* Make sure that the proper markers displayed. */
+        el_adjust_markers (ep);
+    } else {
+        beep();
+    }
+}
+
+/* Process delete character at the current position.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_process_move_cursor_left_or_right (edit_t *    ep)
+{
+    if ((ep->m_0 < ep->ecp && VKEY_LEFT == ep->ch) ||
+        (ep->ecp < ep->ecn && VKEY_RIGHT == ep->ch)) {
+        /* Remove the highlight at the previous position if the removal is needed. */
+        int first_invisible = ep->m_1 + ep->x_mv;
+        el_remove_highlight_in_overwrite_mode(ep);
+        ep->ecp += (VKEY_RIGHT == ep->ch) - (VKEY_LEFT == ep->ch);
+        if (ep->ecp < ep->m_1
+            || ep->ecp > first_invisible
+            || (ep->ecp == first_invisible && ep->ecp != ep->ecn)) {
+            /* scroll right or left as needed */
+            ep->m_1 += (ep->ecp >= first_invisible) - (ep->ecp < ep->m_1);
+            first_invisible = ep->m_1 + ep->x_mv;
+            if (first_invisible < (int)ep->ebs) {
+                char chx = ep->eb[first_invisible];
+                ep->eb[first_invisible] = 0;
+                mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
+                ep->eb[first_invisible] = chx;
+            } else {
+                mvaddstr(ep->efy, ep->x_1, &(ep->eb[ep->m_1]));
+            }
+        }
+        /* Higliht the char in overwrite mode at the current position */
+        el_highlight_in_overwrite_mode(ep);
+        /* Make sure that the proper markers displayed. */
+        el_adjust_markers (ep);
+    } else {
+        beep();
+    }
+}
+
+/* Process destructive backspace.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_process_destructive_backspace (edit_t *   ep)
+{
+    if (ep->m_0 < ep->ecp) {
+        int first_invisible = ep->m_1 + ep->x_mv;
+        int is_scroll_from_left = (ep->m_0 < ep->m_1);
+        assert(ep->ecn >= ep->ecp);
+        --ep->ecn;
+        --ep->ecp;
+        if (is_scroll_from_left) {
+            /* Decrease the left limit, show one more from left. */
+            --ep->m_1;
+            --first_invisible;
+        }
+        if (ep->ecp <= ep->ecn && ep->ecn > ep->m_0) {
+            /* Remove the deleted character. */
+
+            memmove(&(ep->eb[ep->ecp]),
+                    &(ep->eb[ep->ecp + 1]),
+                    (ep->ecn - ep->ecp) + 1);
+
+            if (is_scroll_from_left ||
+                first_invisible < ep->ecn) {
+                /* There is still a hidden part on the right side.
+                 * Remove the highlight and show the modified string.
+                 */
+                if (is_scroll_from_left) {
+                    /* scroll from left, redraw the left side */
+                    char chk = ep->eb[ep->ecp];
+                    ep->eb[ep->ecp] = 0;
+
+                    mvaddstr(ep->efy,
+                             ep->x_1,
+                             &(ep->eb[ep->m_1]));
+
+                    ep->eb[ep->ecp] = chk;
+
+                    mvaddch(ep->efy,
+                            ep->x_1 + ep->ecp - ep->m_1,
+                            chk);
+
+                } else {
+                    /* Learn the first invisible character and replace
+                     * it with a terminating 0.
+                     */
+                    char chr = ep->eb[first_invisible];
+                    ep->eb[first_invisible] = 0;
+                    /* Scroll from right, redraw the right side. */
+                    mvaddstr(ep->efy,
+                            ep->ecp - ep->m_1 + ep->x_1,
+                            &(ep->eb[ep->ecp]));
+                    /* Restore the hidden character in the buffer. */
+                    ep->eb[first_invisible] = chr;
+                }
+            } else {
+                /* The whole string is visible redraw the right side. */
+                mvaddstr(ep->efy,
+                        ep->ecp - ep->m_1 + ep->x_1,
+                        &(ep->eb[ep->ecp]));
+            }
+
+            /* Higliht the char in overwrite mode at the current position */
+            el_highlight_in_overwrite_mode(ep);
+        }
+
+        ep->eb[ep->ecn] = '\0';
+        if (ep->ecn <= first_invisible) {
+            /* Clear the earlier last character position if it is visible */
+            mvaddch(ep->efy,
+                    ep->ecn - ep->m_1 + ep->x_1,
+                    ' ');
+        }
+        /* Make sure that the proper markers displayed. */
+        el_adjust_markers (ep);
+    } else {
+        beep();
+    }
+}
+
+/* Process visible character.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_put_visible_char_in_the_middle (edit_t *    ep)
+{
+    int first_invisible     = ep->m_1 + ep->x_mv;
+    int is_more_on_left     = (first_invisible < ep->ecn || ep->ins_mode);
+    int is_scroll_to_left   = (first_invisible <= ep->ecp + is_more_on_left);
+    int nsl                 = !(is_scroll_to_left);
+
+    if (ep->ins_mode) {
+        /* Right-shift the previous content. */
+        memmove(&ep->eb[ep->ecp + 1],
+                &ep->eb[ep->ecp],
+                (ep->ecn - ep->ecp) + 1);
+        ++ep->ecn;
+    }
+    ep->eb[ep->ecp] = (char)ep->ch;
+    ep->eb[ep->ecn] = '\0';
+    el_show_actual_char(ep);
+    ++ep->ecp;
+
+    if (is_scroll_to_left) {
+        /* Scroll to left */
+        ++ep->m_1;
+        ++first_invisible;
+    }
+    /* Remove the previous highlight if there
+     * was any, and show the modified text.
+     */
+    if (first_invisible < ep->ecn) {
+        /* partial display from the cursor
+         * or from the beginning of the visible part
+         */
+        char    che = ep->eb[first_invisible];
+
+        ep->eb[first_invisible] = 0;
+
+        mvaddstr(ep->efy,
+                 nsl * (ep->ecp - ep->m_1) + ep->x_1,
+                 &(ep->eb[nsl * (ep->ecp - ep->m_1) + ep->m_1]));
+
+        ep->eb[first_invisible] = che;
+    } else {
+        /* display the entire right side from the cursor
+         * or from the beginning of the visible part
+         */
+        mvaddstr(ep->efy,
+                 nsl * (ep->ecp - ep->m_1) + ep->x_1,
+                 &(ep->eb[nsl * (ep->ecp - ep->m_1) + ep->m_1]));
+    }
+
+    /* Higliht the char in overwrite mode at the current position */
+    el_highlight_in_overwrite_mode(ep);
+    /* Make sure that the proper markers displayed. */
+    el_adjust_markers (ep);
+}
+
+/* Process a visible character.
+ * The ep pointer must point to a valid memory location.
+ */
+static
+void
+el_process_visible_char (edit_t *    ep)
+{
+    if (ep->ecn < (int)ep->ebs - 1) {
+        /* There is enough room in the input buffer. */
+        if (ep->ecp < ep->ecn) {
+            /* In the middle of the text. */
+            assert(ep->ecp >= ep->m_1 && ep->m_1 >= ep->m_0);
+            el_put_visible_char_in_the_middle (ep);
+        } else if (ep->ecp == ep->ecn) {
+            /* At the end of the text, insert and overwrite does the same. */
+            int first_invisible = ep->m_1 + ep->x_mv;
+
+            if (ep->ecp >= first_invisible) {
+                if (ep->ecp == first_invisible) {
+                    /* Scroll left. */
+                    ++ep->m_1;
+                    ep->eb[ep->ecp] = (char)ep->ch;
+                    ep->ecn = ++ep->ecp;
+                    ep->eb[ep->ecn] = '\0';
+                    /* Display it. */
                     mvaddstr(ep->efy,
                              ep->x_1,
                              &(ep->eb[ep->m_1]));
+                } else {    
+                    /* Attempt to write way beyond the end of the visible area.
+                     * This should never happen.
+                     */
+                    beep();
+                }
+            } else {
+                /* There is enough room on the display. */
+                ep->eb[ep->ecp] = (char)ep->ch;
+                el_show_actual_char(ep);
+                ep->ecn = ++ep->ecp;
+                ep->eb[ep->ecn] = '\0';
+            }
+            /* Make sure that the proper markers displayed. */
+            el_adjust_markers (ep);
+        } else {
+            /* Attempt to write beyond the end of the text.
+             * This should never happen.
+             */
+            beep();
+        }
+    } else {
+        /* The input buffer is full, no more character can be stored.
+         * This might happen.
+         */
+        beep();
+    }
+}
+
+/* Edit text at a given screen position.
+ * The edit_buffer must point to a valid memory location.
+ *
+ * The first character has a special role, it can specify the prompt.
+ * By default we are using the '$' character for the prompt.
+ * If the text is longer than the edit filed size, than we change the
+ * prompt to '<' and only the end of the text will be displayed first.
+ */
+static
+int
+edit_line (int      edit_field_y,
+           int      edit_field_x,
+           char *   edit_buffer,
+           size_t   edit_buffer_size,
+           size_t   edit_field_size)
+{
+    edit_t es;
+
+    el_init (&es,
+             edit_field_y,
+             edit_field_x,
+             edit_buffer,
+             edit_buffer_size,
+             edit_field_size);
+
+    move(es.efy, es.efx);
+    wclrtoeol(stdscr);
+    /* Display the prompt character. */
+    mvaddch(es.efy, es.x_0, es.prompt);
+
+    /* Display the visible part of the pathname. */
+    move(es.efy, es.x_1);
+    mvaddstr(es.efy, es.x_1, &es.eb[es.m_1]);
+
+    es.ch = VKEY_IGNORE;
+    while ('\r' != es.ch && es.ch != '\n') {
+        /* Break if Esc pressed
+         * Esc should be pressed twice, otherwise we cannot get it.
+         */
+        if (es.ch == 0x1B) {
+            /* Use the zero length to propagate the end condition. */
+            es.ecn = 0;
+            break;
+        }
+        if (el_is_silent_ignore_char(&es)) {
+            /* Silently ignore these characters. */
+        } else if (el_is_loud_ignore_char(&es)) {
+            if (el_is_changeable_prompt_char(&es) && 
+                el_is_cursor_at_rightmost_position(&es)) {
+                /* change the prompt */
+                el_process_change_prompt(&es);
+            } else {
+                /* Loudly ignore these characters. */
+                beep();
+            }
+        } else if (VKEY_INSERT == es.ch) {
+            /* toggle insert mode. */
+            el_process_toggle_insert_mode(&es);
+        } else if (VKEY_DELETE == es.ch) {
+            /* delete character at the current position */
+            el_process_delete_ch_at_current_position(&es);
+        } else if (VKEY_LEFT == es.ch ||
+                   VKEY_RIGHT == es.ch) {
+            /* nondestructive left or right move */
+            el_process_move_cursor_left_or_right(&es);
+        } else if (VKEY_BACK == es.ch || 0x7F == es.ch) {
+            /* destructive backspace */
+            el_process_destructive_backspace(&es);
+        } else if (isprint(es.ch)) {
+            /* visible character */
+            el_process_visible_char(&es);
+        } else {
+            beep();
+        }
+        move(es.efy, es.ecp - es.m_1 + es.x_1);
+        wrefresh(stdscr);
+        es.ch = getkey();
+    }
+    es.eb[es.ecn] = '\0';
+    return es.ecn;
+}
+
+typedef
+void
+(*pathname_function) (char *        working_buffer,
+                      size_t        working_buffsize,
+                      const char *  default_name);
+
+/* Get string. There is no formal check performed.
+ * The buffer is assumed to represent a valid memory location,
+ * violation asserted, but checked against the null pointer value.
+ *
+ * The returned filename might contain a prompt character, therefore
+ * it should be first trimmed by an 'trim_string' function.
+ */
+static
+int
+get_string (char *                  buffer,
+           size_t                   buffsize,
+           const char *             edit_field_name,
+           const char *             default_name,
+           const char *             operation_name,
+           char                     default_prompt,
+           pathname_function        get_pathname)
+{
+    int i = 0;
+    char * temp_str = NULL;
+    int line;
+
+    if (buffsize > 0) {
+        temp_str = (char *)calloc(buffsize, sizeof(char));
+    }
+    assert (buffer != NULL && buffsize > 0);
+    if (buffer != NULL && temp_str != NULL) {
+        #if (LINE_SIZE - LEFT_MIDDLE + 1) < 60
+        #error "Bad parameters, there isn't enough room for status display."
+        #endif
+        char abort_message[LINE_SIZE - LEFT_MIDDLE + 1];
+        size_t  storage_size = sizeof(abort_message);
+        const char * first_part = "Press Esc key twice to abort the '";
+        const char * last_part  = "' operation.";
+
+        strncpy(abort_message, first_part, storage_size);
+        abort_message[sizeof(abort_message) - 1]= '\0';
+        storage_size -= strlen(abort_message) + 1;
+        strncat (abort_message, operation_name, storage_size);
+        storage_size = sizeof(abort_message) - strlen(abort_message) - 1;
+        strncat (abort_message, last_part, storage_size);
 
-                    ep->eb[ep->ecp] = chk;
+        strncpy (temp_str, buffer, buffsize);
+        /* Just a safety measure. */
+        temp_str[buffsize - 1]= '\0';
 
-                    mvaddch(ep->efy,
-                            ep->x_1 + ep->ecp - ep->m_1,
-                            chk);
+        if (get_pathname != NULL) {
+            get_pathname (temp_str,
+                          buffsize,
+                          default_name);
+        }
 
-                } else {
-                    /* Learn the first invisible character and replace
-                     * it with a terminating 0.
+        if ('\0' == *temp_str) {
+            size_t dns = ((default_name != NULL) ? strlen(default_name) : 0);
+            temp_str[0] = default_prompt;
+            if (0 < dns && dns < buffsize - 1) {
+                strcpy(temp_str + 1, default_name);
+            }
+        }
+
+        clear_status();
+        mvaddstr(STATUS_LINE, LEFT_LEFT, edit_field_name);
+        mvaddstr(STATUS_LINE, LEFT_MIDDLE, abort_message);
+
+        i = edit_line(FILE_LINE,
+                      LEFT_LEFT,
+                      temp_str,
+                      buffsize,
+                      LINE_SIZE - LEFT_LEFT - 3);
+
+        if (i > 0) {
+            /* We have a nonzero length string, and the user
+             * didn't abort by pressing the Esc key twice.
+             * Let's copy the new filename to the output buffer. */
+            strcpy (buffer, temp_str);
+        } else {
+            i = 0;
+        }
+
+        /* Reset screen */
+        clear_status();
+        for (line = FILE_LINE; line <= LAST_LINE; ++line) {
+            /* Clear the filename and below from the seen. */
+            move(line, LEFT_LEFT);
+            wclrtoeol(stdscr);
+        }
+        move_to(curx, cury);
+    }
+    free(temp_str);
+    return (i > 0) - 1;
+}
+
+/* Get title string. There is no formal check performed.
+ * The buffer is assumed to represent a valid memory location,
+ * violation asserted, but checked against the null pointer value.
+ *
+ * The returned filename might contain the '>' prompt therefore
+ * it should be first trimmed by the 'trim_title' function.
+ */
+static
+int
+get_title (char *           buffer,
+           size_t           buffsize,
+           const char *     default_name,
+           const char *     operation_name)
+{
+    return get_string (buffer,
+                       buffsize,
+                       "Title:",
+                       default_name,
+                       operation_name,
+                       '%',
+                       NULL);
+}
+
+static
+void
+get_filepath (char *            working_buffer,
+              size_t            working_buffsize,
+              const char *      default_name)
+{
+    char *          wbp = working_buffer;
+    size_t          wbs = working_buffsize;
+    const char *    dn  = default_name;
+    /* Just for the sake of having shorter names. */
+    assert (wbp != NULL && wbs > 0);
+    if (wbp != NULL && wbs > 0) {
+
+        if ('\0' == *wbp) {
+            wbp[0] = '>';
+            assert(dn != NULL && strlen(dn) < 6 + 3);
+            if (0 == getcwd(wbp + 1,
+                            (int)wbs - 1 - 1 - 6 - 3)) {
+                /* The path is probably too long, use the filename alone. */
+                strcpy(wbp + 1, dn);
+            } else {
+                if (dn != NULL) {
+                    /* If the path would make it longer than the line length
+                     * we can use just the filename. If the file name itself
+                     * is too long, than we cannot avoid the wrap around, so
+                     * it's better to be prepared for handling that.
                      */
-                    char chr = ep->eb[first_invisible];
-                    ep->eb[first_invisible] = 0;
-                    /* Scroll from right, redraw the right side. */
-                    mvaddstr(ep->efy,
-                            ep->ecp - ep->m_1 + ep->x_1,
-                            &(ep->eb[ep->ecp]));
-                    /* Restore the hidden character in the buffer. */
-                    ep->eb[first_invisible] = chr;
+                    if (strlen(wbp) + strlen(dn) > wbs) {
+                        wbp[1] = '\0';
+                    } else {
+                        strcat(wbp, "/");
+                    }
+                    strcat(wbp, dn);
                 }
-            } else {
-                /* The whole string is visible redraw the right side. */
-                mvaddstr(ep->efy,
-                        ep->ecp - ep->m_1 + ep->x_1,
-                        &(ep->eb[ep->ecp]));
             }
+            wbp[wbs - 1] = '\0';
+        }
+    }
+}
 
-            /* Higliht the char in overwrite mode at the current position */
-            el_highlight_in_overwrite_mode(ep);
+/* Get a file name. There is no formal check performed.
+ * The buffer is assumed to represent a valid memory location,
+ * violation asserted, but checked against the null pointer value.
+ *
+ * The returned filename might contain the '>' prompt therefore
+ * it should be first trimmed by the 'trim_filename' function.
+ */
+static
+int
+get_filename (char *        buffer,
+              size_t        buffsize,
+              const char *  default_name,
+              const char *  operation_name)
+{
+    return get_string(buffer,
+                      buffsize,
+                      "Filename:",
+                      default_name,
+                      operation_name,
+                      '$',
+                      get_filepath);
+}
+
+static
+const char * 
+trim_string (const char *   buffer,
+             size_t         buffsize,
+             const char *   prefixes)
+{
+    const char * p = buffer;
+    if (p && buffsize > 0) {
+        if (prefixes != NULL &&
+            strchr(prefixes,*p) != NULL) {
+            ++p;
+            --buffsize;
+        }
+        while (buffsize > 0 && ' ' == *p) {
+            ++p;
+            --buffsize;
+        }
+    }
+    if (buffsize == 0) {
+        p = NULL;
+    }
+    return p;
+}
+
+static
+const char * 
+trim_titlename (const char *    buffer,
+                size_t          buffsize)
+{
+    return trim_string(buffer, buffsize, "%");
+}
+
+static
+const char * 
+trim_filename (const char *     buffer,
+               size_t           buffsize)
+{
+    return trim_string(buffer, buffsize, ">|");
+}
+
+static
+void
+save_board (void)
+{
+    solver_t * sv = &solver;
+    const char * p;
+    FILE * f;
+
+    /* Read character input (raw processing mode) */
+
+    if (0 == get_filename(userfile,
+                          sizeof(userfile),
+                          DEFAULT_BOARD_NAME,
+                          "Save board")) {
+
+        p = trim_filename(userfile,
+                          sizeof(userfile));
+
+        if (p != NULL && *p) {
+            if ('|' == userfile[0]) {
+                f = popen(p, "w");
+                if (0 != f) {
+                    print(sv, f, title);
+                    pclose(f);
+                }
+            } else {
+                /* Append for standard formats, else separate file */
+                switch (opt_format) {
+                    case fCompact:
+                    case fStandard:
+                        f = fopen(p, "a");
+                        break;
+                    default:
+                        f = fopen(p, "w");
+                        break;
+                }
+                if (0 != f) {
+                    print(sv, f, title);
+                    fclose(f);
+                }
+            }
+            if (0 == f) {
+                set_status("Error: failed to write the file!");
+            }
+        } else {
+            set_status("Error: no valid file name found!");
         }
+    } else {
+        status_message("Save board operation aborted by the user.");
+    }
+}
+
+/* Write default template to a user-given filename
+ */
+static
+void
+write_template (void)
+{
+    if (0 == get_filename(templatefile,
+                            sizeof(templatefile),
+                            TEMPLATE_FALLBACK,
+                            "Write template")) {
 
-        ep->eb[ep->ecn] = '\0';
-        if (ep->ecn <= first_invisible) {
-            /* Clear the earlier last character position if it is visible */
-            mvaddch(ep->efy,
-                    ep->ecn - ep->m_1 + ep->x_1,
-                    ' ');
+            const char * p = trim_filename(templatefile,
+                                            sizeof(templatefile));
+
+        if (p != NULL && *p) {
+            if (0 == write_default_template(p)) {
+                status_message("Template file successfully created!");
+            } else {
+                beep_status_message("Template file exists"
+                                    " or write error occurred!");
+            }
+        } else {
+            beep_status_message("No valid file name found!");
         }
-        /* Make sure that the proper markers displayed. */
-        el_adjust_markers (ep);
     } else {
-        beep();
+        status_message("Write default template operation aborted by the user.");
     }
 }
 
-/* Process visible character.
- * The ep pointer must point to a valid memory location.
+/* Open saved board(s)
  */
 static
 void
-el_put_visible_char_in_the_middle (edit_t *    ep)
+open_board (void)
 {
-    int first_invisible     = ep->m_1 + ep->x_mv;
-    int is_more_on_left     = (first_invisible < ep->ecn || ep->ins_mode);
-    int is_scroll_to_left   = (first_invisible <= ep->ecp + is_more_on_left);
-    int nsl                 = !(is_scroll_to_left);
+    if (0 == get_filename(userfile,
+                          sizeof(userfile),
+                          DEFAULT_BOARD_NAME,
+                          "Open board")) {
 
-    if (ep->ins_mode) {
-        /* Right-shift the previous content. */
-        memmove(&ep->eb[ep->ecp + 1],
-                &ep->eb[ep->ecp],
-                (ep->ecn - ep->ecp) + 1);
-        ++ep->ecn;
+        const char * p = trim_filename(userfile,
+                                       sizeof(userfile));
+
+        if (p != NULL && *p) {
+            if (opened != NULL) {
+                fclose(opened);
+                opened = NULL;
+            }
+            opened = fopen(p, "r");
+            if (opened != NULL) {
+                load_board();
+            } else {
+                set_status("Error: failed to open the board!");
+            }
+        } else {
+            beep_status_message("No valid file name found!");
+        }
+    } else {
+        status_message("Open board operation aborted by the user.");
     }
-    ep->eb[ep->ecp] = (char)ep->ch;
-    ep->eb[ep->ecn] = '\0';
-    el_show_actual_char(ep);
-    ++ep->ecp;
+}
 
-    if (is_scroll_to_left) {
-        /* Scroll to left */
-        ++ep->m_1;
-        ++first_invisible;
+/* Rename the board title.
+ * Returns a process exit code.
+ */
+static
+void
+rename_board_title (void)
+{
+    char new_title[80];
+    new_title[0]='\0';
+    if (0 == get_title(new_title,
+                        sizeof(new_title),
+                        title,
+                        "Rename the board title")) {
+        const char *    nt;
+        size_t          ts = sizeof(new_title);
+        if (ts > sizeof(title)) {
+            ts = sizeof(title);
+        }
+        nt = trim_titlename(new_title, ts);
+        if (nt != NULL && *nt != '\0') {
+            strcpy(title, nt);
+            write_title(title);
+        }
+        move_to(curx, cury);
     }
-    /* Remove the previous highlight if there
-     * was any, and show the modified text.
-     */
-    if (first_invisible < ep->ecn) {
-        /* partial display from the cursor
-         * or from the beginning of the visible part
-         */
-        char    che = ep->eb[first_invisible];
+}
 
-        ep->eb[first_invisible] = 0;
+/* Cube-and-conquer: a board is split into cubes, boards each with one
+ * more digit filled in than the one they were split from, so that their
+ * solutions are those of the board, with no two cubes sharing any. Each
+ * cube can then be counted on its own (-s -C, -b), and the counts of
+ * all of them merged (-m) into that of the board.
+ */
+#define MAX_CUBES               4096
 
-        mvaddstr(ep->efy,
-                 nsl * (ep->ecp - ep->m_1) + ep->x_1,
-                 &(ep->eb[nsl * (ep->ecp - ep->m_1) + ep->m_1]));
+/* Fill in the digits of a cube as fixed squares */
+static
+void
+load_cube (solver_t * sv, const unsigned char * cell)
+{
+    int i;
 
-        ep->eb[first_invisible] = che;
-    } else {
-        /* display the entire right side from the cursor
-         * or from the beginning of the visible part
-         */
-        mvaddstr(ep->efy,
-                 nsl * (ep->ecp - ep->m_1) + ep->x_1,
-                 &(ep->eb[nsl * (ep->ecp - ep->m_1) + ep->m_1]));
+    reset(sv);
+    for (i = 0; i < 81; ++i) {
+        if (0 != cell[i]) {
+            fill(sv, i, cell[i]);
+            sv->board[i] |= FIXED;
+        }
     }
+}
 
-    /* Higliht the char in overwrite mode at the current position */
-    el_highlight_in_overwrite_mode(ep);
-    /* Make sure that the proper markers displayed. */
-    el_adjust_markers (ep);
+/* Print a cube, titled after the board with its number appended; the
+ * title is cut short so as to be read back whole (c.f. read_board()).
+ */
+static
+void
+print_cube (const solver_t * sv, int number)
+{
+    char name[sizeof(title)];
+
+    sprintf(name, "%.*s #%d", (int)sizeof(title) - 14, title, number);
+    print(sv, stdout, name);
 }
 
-/* Process a visible character.
- * The ep pointer must point to a valid memory location.
+/* Split the board into at least 'cubes' cubes, and print them. Cubes
+ * are split in turn, in the order they were made: after filling in the
+ * singles, one cube for each digit allowed in the square choice() picks.
+ * Cubes without a solution are dropped, and solved ones printed as is;
+ * if that drops them all, the board itself is printed as the only cube,
+ * so that its count of 0 still shows once merged.
  */
 static
 void
-el_process_visible_char (edit_t *    ep)
+split_cubes (solver_t * sv, int cubes)
 {
-    if (ep->ecn < (int)ep->ebs - 1) {
-        /* There is enough room in the input buffer. */
-        if (ep->ecp < ep->ecn) {
-            /* In the middle of the text. */
-            assert(ep->ecp >= ep->m_1 && ep->m_1 >= ep->m_0);
-            el_put_visible_char_in_the_middle (ep);
-        } else if (ep->ecp == ep->ecn) {
-            /* At the end of the text, insert and overwrite does the same. */
-            int first_invisible = ep->m_1 + ep->x_mv;
+    static unsigned char queue[MAX_CUBES][81];
+    unsigned char board[81];
+    int head = 0, size = 1, number = 0, i, idx, digit, tail;
 
-            if (ep->ecp >= first_invisible) {
-                if (ep->ecp == first_invisible) {
-                    /* Scroll left. */
-                    ++ep->m_1;
-                    ep->eb[ep->ecp] = (char)ep->ch;
-                    ep->ecn = ++ep->ecp;
-                    ep->eb[ep->ecn] = '\0';
-                    /* Display it. */
-                    mvaddstr(ep->efy,
-                             ep->x_1,
-                             &(ep->eb[ep->m_1]));
-                } else {    
-                    /* Attempt to write way beyond the end of the visible area.
-                     * This should never happen.
-                     */
-                    beep();
+    for (i = 0; i < 81; ++i) {
+        board[i] = queue[0][i] = (unsigned char)DIGIT(sv, i);
+    }
+    while (0 < size && number + size < cubes && size + 9 <= MAX_CUBES) {
+        load_cube(sv, queue[head]);
+        head = (head + 1) % MAX_CUBES;
+        --size;
+        if (-1 == fill_singles(sv) || -1 > (idx = choice(sv))) {
+            continue;
+        }
+        if (-1 == idx) {
+            print_cube(sv, ++number);
+            continue;
+        }
+        for (digit = 1; digit <= 9; ++digit) {
+            if (!DISALLOWED(sv, idx, digit)) {
+                tail = (head + size++) % MAX_CUBES;
+                for (i = 0; i < 81; ++i) {
+                    queue[tail][i] = (unsigned char)DIGIT(sv, i);
                 }
-            } else {
-                /* There is enough room on the display. */
-                ep->eb[ep->ecp] = (char)ep->ch;
-                el_show_actual_char(ep);
-                ep->ecn = ++ep->ecp;
-                ep->eb[ep->ecn] = '\0';
+                queue[tail][idx] = (unsigned char)digit;
             }
-            /* Make sure that the proper markers displayed. */
-            el_adjust_markers (ep);
-        } else {
-            /* Attempt to write beyond the end of the text.
-             * This should never happen.
-             */
-            beep();
         }
-    } else {
-        /* The input buffer is full, no more character can be stored.
-         * This might happen.
-         */
-        beep();
+    }
+    for (; 0 < size; --size) {
+        load_cube(sv, queue[head]);
+        head = (head + 1) % MAX_CUBES;
+        print_cube(sv, ++number);
+    }
+    if (0 == number) {
+        load_cube(sv, board);
+        print_cube(sv, ++number);
     }
 }
 
-/* Edit text at a given screen position.
- * The edit_buffer must point to a valid memory location.
- *
- * The first character has a special role, it can specify the prompt.
- * By default we are using the '$' character for the prompt.
- * If the text is longer than the edit filed size, than we change the
- * prompt to '<' and only the end of the text will be displayed first.
+/* Merge the counts of cubes, as printed by -s -C, from 'filename' (or
+ * stdin if "-"): the counts of the boards titled "<title> #<number>" are
+ * summed for each title, in the order first seen. A sum followed by '+'
+ * includes a count that reached its limit. Returns a process exit code.
  */
+#define MAX_MERGED              1024
+
+typedef struct merged_s {
+    char    title[sizeof(title)];
+    double  count;                  /* Exact beyond the range of an int  */
+    int     capped;
+} merged_t;
+
 static
 int
-edit_line (int      edit_field_y,
-           int      edit_field_x,
-           char *   edit_buffer,
-           size_t   edit_buffer_size,
-           size_t   edit_field_size)
+merge_counts (const char * filename)
 {
-    edit_t es;
-
-    el_init (&es,
-             edit_field_y,
-             edit_field_x,
-             edit_buffer,
-             edit_buffer_size,
-             edit_field_size);
-
-    move(es.efy, es.efx);
-    wclrtoeol(stdscr);
-    /* Display the prompt character. */
-    mvaddch(es.efy, es.x_0, es.prompt);
-
-    /* Display the visible part of the pathname. */
-    move(es.efy, es.x_1);
-    mvaddstr(es.efy, es.x_1, &es.eb[es.m_1]);
+    static merged_t merged[MAX_MERGED];
+    char buf[256];
+    char * p, * q;
+    int i, capped, n = 0;
+    long count;
+    FILE * f = 0 == strcmp("-", filename) ? stdin : fopen(filename, "r");
 
-    es.ch = VKEY_IGNORE;
-    while ('\r' != es.ch && es.ch != '\n') {
-        /* Break if Esc pressed
-         * Esc should be pressed twice, otherwise we cannot get it.
-         */
-        if (es.ch == 0x1B) {
-            /* Use the zero length to propagate the end condition. */
-            es.ecn = 0;
-            break;
-        }
-        if (el_is_silent_ignore_char(&es)) {
-            /* Silently ignore these characters. */
-        } else if (el_is_loud_ignore_char(&es)) {
-            if (el_is_changeable_prompt_char(&es) && 
-                el_is_cursor_at_rightmost_position(&es)) {
-                /* change the prompt */
-                el_process_change_prompt(&es);
-            } else {
-                /* Loudly ignore these characters. */
-                beep();
-            }
-        } else if (VKEY_INSERT == es.ch) {
-            /* toggle insert mode. */
-            el_process_toggle_insert_mode(&es);
-        } else if (VKEY_DELETE == es.ch) {
-            /* delete character at the current position */
-            el_process_delete_ch_at_current_position(&es);
-        } else if (VKEY_LEFT == es.ch ||
-                   VKEY_RIGHT == es.ch) {
-            /* nondestructive left or right move */
-            el_process_move_cursor_left_or_right(&es);
-        } else if (VKEY_BACK == es.ch || 0x7F == es.ch) {
-            /* destructive backspace */
-            el_process_destructive_backspace(&es);
-        } else if (isprint(es.ch)) {
-            /* visible character */
-            el_process_visible_char(&es);
-        } else {
-            beep();
+    if (0 == f) {
+        fprintf(stderr, "Error: failed to open '%s'\n", filename);
+        return -1;
+    }
+    while (0 != fgets(buf, sizeof(buf), f)) {
+        /* Only lines of counts: "<count>[+] : <title> #<number>" */
+        count = strtol(buf, &p, 10);
+        if (p == buf || 0 == (q = strstr(p, " : "))) {
+            continue;
         }
-        move(es.efy, es.ecp - es.m_1 + es.x_1);
-        wrefresh(stdscr);
-        es.ch = getkey();
+        capped = '+' == *p;
+        q += 3;
+        for (p = q + strlen(q); p > q && isspace(p[-1]); --p) {
+            ;
+        }
+        *p = '\0';
+        for (; p > q && isdigit(p[-1]); --p) {
+            ;
+        }
+        if (p - 2 > q && '#' == p[-1] && ' ' == p[-2] && '\0' != *p) {
+            p[-2] = '\0';
+        }
+
+        for (i = 0; i < n && 0 != strcmp(merged[i].title, q); ++i) {
+            ;
+        }
+        if (i == n) {
+            if (MAX_MERGED == n) {
+                fprintf(stderr, "Error: too many boards to merge\n");
+                break;
+            }
+            strncpy(merged[n].title, q, sizeof(merged[n].title) - 1);
+            merged[n].count = 0;
+            merged[n].capped = 0;
+            ++n;
+        }
+        merged[i].count += count;
+        merged[i].capped |= capped;
     }
-    es.eb[es.ecn] = '\0';
-    return es.ecn;
+    if (f != stdin) {
+        fclose(f);
+    }
+    for (i = 0; i < n; ++i) {
+        printf("%6.0f%c : %s\n", merged[i].count,
+               merged[i].capped ? '+' : ' ', merged[i].title);
+    }
+    return 0;
 }
 
-typedef
-void
-(*pathname_function) (char *        working_buffer,
-                      size_t        working_buffsize,
-                      const char *  default_name);
-
-/* Get string. There is no formal check performed.
- * The buffer is assumed to represent a valid memory location,
- * violation asserted, but checked against the null pointer value.
- *
- * The returned filename might contain a prompt character, therefore
- * it should be first trimmed by an 'trim_string' function.
+/* Boards of other sizes (-G): N = rows * cols symbols, on N rows, N
+ * columns and N boxes of 'rows' by 'cols' squares, from 4x4 boards
+ * (2x2 boxes) up to 25x25 (5x5 boxes). Symbols past 9 are letters, so
+ * that 'A' is 10 and 'P' is 25. The classic 9x9 board keeps the solver
+ * above, specialised for its size; other boards are solved by singles
+ * and guesses over tables built for the size at run time.
  */
+#define GRID_MAX                25
+#define GRID_SQUARES            (GRID_MAX * GRID_MAX)
+#define GRID_BIT(symbol)        (1u << ((symbol) - 1))
+
+static const char grid_symbols[] = "123456789ABCDEFGHIJKLMNOP";
+
+typedef struct grid_s {
+    int             rows, cols;                 /* Size of a box         */
+    int             size, squares;              /* Symbols, squares      */
+    unsigned int    full;                       /* All symbols           */
+    unsigned char   digit[GRID_SQUARES];
+    unsigned int    used[3 * GRID_MAX];         /* Symbols of each unit  */
+    short           unit_cell[3 * GRID_MAX][GRID_MAX];
+    unsigned char   cell_unit[GRID_SQUARES][3];
+    short           trail[GRID_SQUARES];        /* Squares filled, undo  */
+    int             filled;
+    int             order[GRID_MAX];            /* Symbols in turn       */
+    unsigned char   solution[GRID_SQUARES];     /* Last solution found   */
+    long            nodes, budget, guesses;
+    int             shuffle;                    /* Random symbol order   */
+    int             verbose;                    /* Print each solution   */
+} grid_t;
+
+static grid_t grid;
+
+#define GRID_ALLOWED(g,idx)     ((g)->full                               \
+                                 & ~((g)->used[(g)->cell_unit[idx][0]]  \
+                                     | (g)->used[(g)->cell_unit[idx][1]]\
+                                     | (g)->used[(g)->cell_unit[idx][2]]))
+
 static
 int
-get_string (char *                  buffer,
-           size_t                   buffsize,
-           const char *             edit_field_name,
-           const char *             default_name,
-           const char *             operation_name,
-           char                     default_prompt,
-           pathname_function        get_pathname)
+grid_numset (unsigned int mask)
 {
-    int i = 0;
-    char * temp_str = NULL;
-    int line;
+#if defined (__GNUC__)
+    return __builtin_popcount(mask);
+#else
+    int n;
+    for (n = 0; 0 != mask; mask &= mask - 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
 
-    if (buffsize > 0) {
-        temp_str = (char *)calloc(buffsize, sizeof(char));
+/* Set up the units of an empty board of boxes 'rows' by 'cols' */
+static
+void
+grid_init (grid_t * g, int rows, int cols)
+{
+    int row, col, box, idx, n[3 * GRID_MAX];
+
+    g->rows = rows;
+    g->cols = cols;
+    g->size = rows * cols;
+    g->squares = g->size * g->size;
+    g->full = (1u << g->size) - 1;
+    memset(g->digit, 0x00, sizeof(g->digit));
+    memset(g->used, 0x00, sizeof(g->used));
+    memset(n, 0x00, sizeof(n));
+    g->filled = 0;
+    for (idx = 0; idx < g->size; ++idx) {
+        g->order[idx] = idx + 1;
+    }
+    for (row = 0; row < g->size; ++row) {
+        for (col = 0; col < g->size; ++col) {
+            idx = row * g->size + col;
+            box = 2 * g->size + (row / rows) * rows + col / cols;
+            g->cell_unit[idx][0] = (unsigned char)row;
+            g->cell_unit[idx][1] = (unsigned char)(g->size + col);
+            g->cell_unit[idx][2] = (unsigned char)box;
+            g->unit_cell[row][n[row]++] = (short)idx;
+            g->unit_cell[g->size + col][n[g->size + col]++] = (short)idx;
+            g->unit_cell[box][n[box]++] = (short)idx;
+        }
     }
-    assert (buffer != NULL && buffsize > 0);
-    if (buffer != NULL && temp_str != NULL) {
-        #if (LINE_SIZE - LEFT_MIDDLE + 1) < 60
-        #error "Bad parameters, there isn't enough room for status display."
-        #endif
-        char abort_message[LINE_SIZE - LEFT_MIDDLE + 1];
-        size_t  storage_size = sizeof(abort_message);
-        const char * first_part = "Press Esc key twice to abort the '";
-        const char * last_part  = "' operation.";
+}
 
-        strncpy(abort_message, first_part, storage_size);
-        abort_message[sizeof(abort_message) - 1]= '\0';
-        storage_size -= strlen(abort_message) + 1;
-        strncat (abort_message, operation_name, storage_size);
-        storage_size = sizeof(abort_message) - strlen(abort_message) - 1;
-        strncat (abort_message, last_part, storage_size);
+/* Fill in a square; returns 0 on success, else -1 if not allowed */
+static
+int
+grid_set (grid_t * g, int idx, int symbol)
+{
+    int i;
+    if (0 != g->digit[idx] || 0 == (GRID_ALLOWED(g, idx) & GRID_BIT(symbol))) {
+        return -1;
+    }
+    g->digit[idx] = (unsigned char)symbol;
+    for (i = 0; i < 3; ++i) {
+        g->used[g->cell_unit[idx][i]] |= GRID_BIT(symbol);
+    }
+    g->trail[g->filled++] = (short)idx;
+    return 0;
+}
 
-        strncpy (temp_str, buffer, buffsize);
-        /* Just a safety measure. */
-        temp_str[buffsize - 1]= '\0';
+/* Empty the squares filled since the trail held 'mark' of them */
+static
+void
+grid_undo (grid_t * g, int mark)
+{
+    int i, idx;
+    while (mark < g->filled) {
+        idx = g->trail[--g->filled];
+        for (i = 0; i < 3; ++i) {
+            g->used[g->cell_unit[idx][i]] &= ~GRID_BIT(g->digit[idx]);
+        }
+        g->digit[idx] = 0;
+    }
+}
 
-        if (get_pathname != NULL) {
-            get_pathname (temp_str,
-                          buffsize,
-                          default_name);
+/* Fill in the given symbols (0 for a blank) of a new board;
+ * returns 0 on success, else -1 if two of them clash
+ */
+static
+int
+grid_load (grid_t * g, const unsigned char * cell)
+{
+    int idx;
+    grid_init(g, g->rows, g->cols);
+    for (idx = 0; idx < g->squares; ++idx) {
+        if (0 != cell[idx] && 0 != grid_set(g, idx, cell[idx])) {
+            return -1;
         }
+    }
+    return 0;
+}
 
-        if ('\0' == *temp_str) {
-            size_t dns = ((default_name != NULL) ? strlen(default_name) : 0);
-            temp_str[0] = default_prompt;
-            if (0 < dns && dns < buffsize - 1) {
-                strcpy(temp_str + 1, default_name);
+/* Fill in naked and hidden singles until there are none left;
+ * returns 0 on success, else -1 on a contradiction
+ */
+static
+int
+grid_propagate (grid_t * g)
+{
+    int changed = 1, idx, unit, i, symbol;
+    unsigned int allowed, once, twice, hidden;
+
+    while (changed) {
+        changed = 0;
+        for (idx = 0; idx < g->squares; ++idx) {
+            if (0 == g->digit[idx]) {
+                allowed = GRID_ALLOWED(g, idx);
+                if (0 == allowed) {
+                    return -1;
+                }
+                if (0 == (allowed & (allowed - 1))) {
+                    for (symbol = 1; GRID_BIT(symbol) != allowed; ++symbol) {
+                        ;
+                    }
+                    grid_set(g, idx, symbol);
+                    changed = 1;
+                }
             }
         }
+        for (unit = 0; unit < 3 * g->size; ++unit) {
+            once = twice = 0;
+            for (i = 0; i < g->size; ++i) {
+                idx = g->unit_cell[unit][i];
+                if (0 == g->digit[idx]) {
+                    allowed = GRID_ALLOWED(g, idx);
+                    twice |= once & allowed;
+                    once |= allowed;
+                }
+            }
+            if (g->full != (once | g->used[unit])) {
+                return -1;          /* A symbol with nowhere to go */
+            }
+            for (hidden = once & ~twice; 0 != hidden; hidden &= hidden - 1) {
+                for (symbol = 1; 0 == (hidden & GRID_BIT(symbol)); ++symbol) {
+                    ;
+                }
+                for (i = 0; i < g->size; ++i) {
+                    idx = g->unit_cell[unit][i];
+                    if (0 == grid_set(g, idx, symbol)) {
+                        break;
+                    }
+                }
+                if (i == g->size) {
+                    return -1;      /* Its square took another symbol */
+                }
+                changed = 1;
+            }
+        }
+    }
+    return 0;
+}
 
-        clear_status();
-        mvaddstr(STATUS_LINE, LEFT_LEFT, edit_field_name);
-        mvaddstr(STATUS_LINE, LEFT_MIDDLE, abort_message);
-
-        i = edit_line(FILE_LINE,
-                      LEFT_LEFT,
-                      temp_str,
-                      buffsize,
-                      LINE_SIZE - LEFT_LEFT - 3);
-
-        if (i > 0) {
-            /* We have a nonzero length string, and the user
-             * didn't abort by pressing the Esc key twice.
-             * Let's copy the new filename to the output buffer. */
-            strcpy (buffer, temp_str);
-        } else {
-            i = 0;
+/* Pick the empty square with the fewest symbols allowed, or -1 if none */
+static
+int
+grid_choice (grid_t * g)
+{
+    int idx, n, best = -1, fewest = GRID_MAX + 1;
+    for (idx = 0; idx < g->squares && 2 < fewest; ++idx) {
+        if (0 == g->digit[idx]) {
+            n = grid_numset(GRID_ALLOWED(g, idx));
+            if (n < fewest) {
+                fewest = n;
+                best = idx;
+            }
         }
+    }
+    return best;
+}
 
-        /* Reset screen */
-        clear_status();
-        for (line = FILE_LINE; line <= LAST_LINE; ++line) {
-            /* Clear the filename and below from the seen. */
-            move(line, LEFT_LEFT);
-            wclrtoeol(stdscr);
+/* Write text representation to given file, as text() does */
+static
+void
+grid_text (const grid_t * g, FILE * f, const char * title)
+{
+    int i, k, box, row, col;
+    if (fCSV != opt_format) {
+        if (0 != title) {
+            fprintf(f, "%% %s\n", title);
+        }
+        for (i = 0; i < g->squares; ++i) {
+            row = i / g->size;
+            col = i % g->size;
+            if (0 == g->digit[i]) {
+                fprintf(f, fStandard == opt_format ? " ." : ".");
+            } else {
+                fprintf(f, fStandard == opt_format ? " %c" : "%c",
+                            grid_symbols[g->digit[i] - 1]);
+            }
+            if (g->size - 1 == col) {
+                fprintf(f, "\n");
+                if (fStandard == opt_format && row != g->size - 1
+                    && g->rows - 1 == row % g->rows) {
+                    for (box = 0; box < g->rows; ++box) {
+                        fprintf(f, 0 == box ? "-" : "+-");
+                        for (k = 0; k < g->cols; ++k) {
+                            fprintf(f, "--");
+                        }
+                    }
+                    fprintf(f, "\n");
+                }
+            } else if (fStandard == opt_format
+                       && g->cols - 1 == col % g->cols) {
+                fprintf(f, " |");
+            }
+        }
+    } else {
+        for (i = 0; i < g->squares; ++i) {
+            if (0 != g->digit[i]) {
+                fprintf(f, "%c", grid_symbols[g->digit[i] - 1]);
+            }
+            fprintf(f, g->size - 1 == i % g->size ? "\n" : ",");
         }
-        move_to(curx, cury);
     }
-    free(temp_str);
-    return (i > 0) - 1;
 }
 
-/* Get title string. There is no formal check performed.
- * The buffer is assumed to represent a valid memory location,
- * violation asserted, but checked against the null pointer value.
- *
- * The returned filename might contain the '>' prompt therefore
- * it should be first trimmed by the 'trim_title' function.
+/* Count the solutions of the board, up to 'limit', trying the symbols
+ * in g->order (or a random order for each square, if g->shuffle); the
+ * board is left as it was. The last solution found is
+ * kept in g->solution, and printed if g->verbose. Searching more than
+ * g->budget squares (unless 0) gives up, as if 'limit' were reached.
  */
 static
 int
-get_title (char *           buffer,
-           size_t           buffsize,
-           const char *     default_name,
-           const char *     operation_name)
+grid_count (grid_t * g, int limit)
 {
-    return get_string (buffer,
-                       buffsize,
-                       "Title:",
-                       default_name,
-                       operation_name,
-                       '%',
-                       NULL);
+    int mark = g->filled, n = 0, i, idx, guess, order[GRID_MAX];
+    unsigned int allowed;
+
+    if (0 != g->budget && g->budget < ++g->nodes) {
+        return limit;
+    }
+    if (0 == grid_propagate(g)) {
+        idx = grid_choice(g);
+        if (-1 == idx) {
+            memcpy(g->solution, g->digit, sizeof(g->solution));
+            if (g->verbose) {
+                grid_text(g, stdout, title);
+            }
+            n = 1;
+        } else {
+            ++g->guesses;
+            allowed = GRID_ALLOWED(g, idx);
+            guess = g->filled;
+            memcpy(order, g->order, sizeof(order));
+            if (g->shuffle) {
+                shuffle(order, g->size, 0);
+            }
+            for (i = 0; i < g->size && n < limit; ++i) {
+                if (0 != (allowed & GRID_BIT(order[i]))) {
+                    grid_set(g, idx, order[i]);
+                    n += grid_count(g, limit - n);
+                    grid_undo(g, guess);
+                }
+            }
+        }
+    }
+    grid_undo(g, mark);
+    return n;
 }
 
+/* Read the next board from 'f', as read_board() does, into 'g' (which
+ * sets the size); symbols are read as written by grid_text(), and any
+ * other character (such as '.') is a blank square. A verbose board
+ * (with '|' between boxes) may have its separator lines anywhere.
+ *
+ * Return 0 on success; else -1 on error
+ */
 static
-void
-get_filepath (char *            working_buffer,
-              size_t            working_buffsize,
-              const char *      default_name)
+int
+grid_read (grid_t * g, FILE * f)
 {
-    char *          wbp = working_buffer;
-    size_t          wbs = working_buffsize;
-    const char *    dn  = default_name;
-    /* Just for the sake of having shorter names. */
-    assert (wbp != NULL && wbs > 0);
-    if (wbp != NULL && wbs > 0) {
+    static char buf[256];
+    unsigned char cell[GRID_SQUARES];
+    const char * s;
+    char * p, * q;
+    int row, col, symbol, type = COMPACT;
 
-        if ('\0' == *wbp) {
-            wbp[0] = '>';
-            assert(dn != NULL && strlen(dn) < 6 + 3);
-            if (0 == getcwd(wbp + 1,
-                            (int)wbs - 1 - 1 - 6 - 3)) {
-                /* The path is probably too long, use the filename alone. */
-                strcpy(wbp + 1, dn);
-            } else {
-                if (dn != NULL) {
-                    /* If the path would make it longer than the line length
-                     * we can use just the filename. If the file name itself
-                     * is too long, than we cannot avoid the wrap around, so
-                     * it's better to be prepared for handling that.
-                     */
-                    if (strlen(wbp) + strlen(dn) > wbs) {
-                        wbp[1] = '\0';
-                    } else {
-                        strcat(wbp, "/");
-                    }
-                    strcat(wbp, dn);
+    /* Skip lines until a '%' is found */
+    buf[0] = ' ';
+    while ('%' != buf[0]) {
+        if (0 == fgets(buf, sizeof(buf), f)) {
+            return -1;
+        }
+    }
+    /* Read optional title, and removing trailing whitespace */
+    for (p = buf + 1; *p && isspace(*p); ++p) {
+       ;
+    }
+    if (*p) {
+        strncpy(title, p, sizeof(title) - 1);
+        title[sizeof(title) - 1] = '\0';
+        for (q = title + strlen(title); q > title && isspace(q[-1]); --q) {
+           ;
+        }
+        *q = '\0';
+    } else {
+        strcpy(title, "(untitled)");
+    }
+    /* Consume comment lines - no leading spaces allowed */
+    buf[0] = '#';
+    while ('#' == buf[0]) {
+        if (0 == fgets(buf, sizeof(buf), f)) {
+            return -1;
+        }
+    }
+    if (0 != strchr(buf, '|')) {
+        type = VERBOSE;
+    }
+    memset(cell, 0x00, sizeof(cell));
+    for (row = 0; row < g->size; ++row) {
+        for (p = buf; *p && isspace(*p); ++p) {
+           ;
+        }
+        for (col = 0; *p && col < g->size; ++col, ++p) {
+            if (VERBOSE == type) {
+                while (*p && (isspace(*p) || '|' == *p)) {
+                    ++p;
                 }
             }
-            wbp[wbs - 1] = '\0';
+            s = *p ? strchr(grid_symbols, toupper((unsigned char)*p)) : 0;
+            symbol = 0 != s ? (int)(s - grid_symbols) + 1 : 0;
+            if (symbol <= g->size) {
+                cell[row * g->size + col] = (unsigned char)symbol;
+            }
+            /* else assume blank square */
+        }
+
+        /* Load next line (if needed), skipping separators */
+        while (row < g->size - 1) {
+            if (0 == fgets(buf, sizeof(buf), f)) {
+                return -1;
+            }
+            for (p = buf; *p && isspace(*p); ++p) {
+               ;
+            }
+            if (VERBOSE != type || ('-' != *p && '+' != *p)) {
+                break;
+            }
         }
     }
+    return grid_load(g, cell);
 }
 
-/* Get a file name. There is no formal check performed.
- * The buffer is assumed to represent a valid memory location,
- * violation asserted, but checked against the null pointer value.
- *
- * The returned filename might contain the '>' prompt therefore
- * it should be first trimmed by the 'trim_filename' function.
+/* Generate a board: fill in a random solution, then blank squares in
+ * pairs symmetric about the centre, in random order, keeping a pair
+ * only if the board still has a single solution. A board that takes
+ * too long to count (more guesses than squares) or fill is taken to
+ * have many solutions, so the boards made are the easier ones.
  */
 static
-int
-get_filename (char *        buffer,
-              size_t        buffsize,
-              const char *  default_name,
-              const char *  operation_name)
+void
+grid_generate (grid_t * g)
 {
-    return get_string(buffer,
-                      buffsize,
-                      "Filename:",
-                      default_name,
-                      operation_name,
-                      '$',
-                      get_filepath);
+    unsigned char cell[GRID_SQUARES], solved[GRID_SQUARES];
+    int order[GRID_SQUARES];
+    int i, idx, pair;
+
+    do {
+        grid_init(g, g->rows, g->cols);
+        g->nodes = g->guesses = 0;
+        g->budget = 100L * g->squares;
+        g->shuffle = 1;
+    } while (1 != grid_count(g, 1) || g->budget < g->nodes);
+    g->shuffle = 0;
+    memcpy(solved, g->solution, sizeof(solved));
+    memcpy(cell, solved, sizeof(cell));
+
+    for (i = 0; i < g->squares; ++i) {
+        order[i] = i;
+    }
+    shuffle(order, g->squares, 0);
+    for (i = 0; i < g->squares; ++i) {
+        idx = order[i];
+        pair = g->squares - 1 - idx;
+        if (0 == cell[idx]) {
+            continue;
+        }
+        cell[idx] = cell[pair] = 0;
+        grid_load(g, cell);
+        g->nodes = 0;
+        g->budget = g->squares;
+        if (1 != grid_count(g, 2) || g->budget < g->nodes) {
+            cell[idx] = solved[idx];
+            cell[pair] = solved[pair];
+        }
+    }
+    grid_load(g, cell);
+    g->budget = 0;
+    sprintf(title, "randomly generated - %dx%d", g->size, g->size);
 }
 
+/* Generate (-g), or solve and count (-s, -v), boards of the size set by
+ * -G, as main() and gen_statistics() do for 9x9 boards.
+ * Returns a process exit code.
+ */
 static
-const char * 
-trim_string (const char *   buffer,
-             size_t         buffsize,
-             const char *   prefixes)
+int
+grid_boards (void)
 {
-    const char * p = buffer;
-    if (p && buffsize > 0) {
-        if (prefixes != NULL &&
-            strchr(prefixes,*p) != NULL) {
-            ++p;
-            --buffsize;
+    grid_t * g = &grid;
+    int n;
+
+    grid_init(g, opt_grid_rows, opt_grid_cols);
+    if (0 != opt_generate) {
+        if (0 == num_generate) {
+            num_generate = 10000;
         }
-        while (buffsize > 0 && ' ' == *p) {
-            ++p;
-            --buffsize;
+        for (n = 0; n < num_generate; ++n) {
+            rng_seed(&rng, (zkey_t)(opt_first + n));
+            grid_generate(g);
+            grid_text(g, stdout, title);
         }
+        return 0;
     }
-    if (buffsize == 0) {
-        p = NULL;
+    if (0 == precanned) {
+        fprintf(stderr, "Error: no precanned boards loaded\n");
+        return -1;
     }
-    return p;
-}
 
-static
-const char * 
-trim_titlename (const char *    buffer,
-                size_t          buffsize)
-{
-    return trim_string(buffer, buffsize, "%");
-}
+    fseek (precanned, 0, SEEK_SET);
+    while (0 == grid_read(g, precanned)) {
+        if (0 != opt_board && 0 != strcmp(opt_board, title)) {
+            continue;
+        }
+        g->nodes = g->guesses = g->budget = 0;
 
-static
-const char * 
-trim_filename (const char *     buffer,
-               size_t           buffsize)
-{
-    return trim_string(buffer, buffsize, ">|");
+        /* Counting only: report the number of solutions, capped */
+        if (0 != opt_count && 0 == opt_solve) {
+            n = grid_count(g, opt_count);
+            printf("%6d%c : %s\n", n, n == opt_count ? '+' : ' ', title);
+            continue;
+        }
+
+        n = grid_count(g, 0 == opt_solve ? 2 : 1);
+        if (0 == n) {
+            printf("Board '%s' has no solution\n", title);
+        } else if (1 < n) {
+            printf("Board '%s' has multiple solutions\n", title);
+        } else if (0 == opt_solve) {
+            printf("%2ld %-12s : %s\n", g->guesses,
+                   0 == g->guesses ? "singles" : "guessing", title);
+        } else {
+            printf("Solution(s) to '%s'\n", title);
+            g->verbose = 1;
+            grid_count(g, INT_MAX);
+            g->verbose = 0;
+        }
+    }
+    return 0;
 }
 
+/* Classify or solve the board loaded in 'sv' (-s, -v), titled 'name',
+ * writing the outcome to 'f'; 'unique' tells that singles alone solve
+ * it, and 'trial' is a scratch context (c.f. dispatch()).
+ */
 static
 void
-save_board (void)
+stat_board (solver_t * sv, solver_t * trial, int unique,
+            const char * name, FILE * f)
 {
-    const char * p;
-    FILE * f;
+    const char * classification;
+    int n;
+
+    /* Counting only: report the number of solutions, capped */
+    if (0 != opt_count && 0 == opt_solve) {
+        if (unique) {
+            n = 1;
+        } else
+#if defined (HAVE_THREADS)
+        if (1 < opt_threads) {
+            n = count_parallel(sv, opt_count, opt_threads);
+        } else
+#endif
+        if (eSearch == sv->engine) {
+            n = count_completions(sv, opt_count);
+        } else {
+            n = count_solutions(sv, opt_count);
+        }
+        fprintf(f, "%6d%c : %s\n", n, n == opt_count ? '+' : ' ', name);
+        return;
+    }
 
-    /* Read character input (raw processing mode) */
+    if (eAuto == opt_engine) {
+        dispatch(sv, trial);
+    }
 
-    if (0 == get_filename(userfile,
-                          sizeof(userfile),
-                          DEFAULT_BOARD_NAME,
-                          "Save board")) {
+    /* Solving needs one solution; statistics need exactly one,
+     * known already of a board solved by singles alone
+     */
+    if (unique) {
+        n = 1;
+    } else
+#if defined (HAVE_THREADS)
+    if (1 < opt_threads) {
+        n = count_parallel(sv, 0 == opt_solve ? 2 : 1, opt_threads);
+    } else
+#endif
+    n = count_solutions(sv, 0 == opt_solve ? 2 : 1);
 
-        p = trim_filename(userfile,
-                          sizeof(userfile));
+    /* Ignore insoluble boards */
+    if (0 == n) {
+        fprintf(f, "Board '%s' has no solution\n", name);
+        return;
+    }
 
-        if (p != NULL && *p) {
-            if ('|' == userfile[0]) {
-                f = popen(p, "w");
-                if (0 != f) {
-                    print(f, title);
-                    pclose(f);
-                }
-            } else {
-                /* Append for standard formats, else separate file */
-                switch (opt_format) {
-                    case fCompact:
-                    case fStandard:
-                        f = fopen(p, "a");
-                        break;
-                    default:
-                        f = fopen(p, "w");
-                        break;
-                }
-                if (0 != f) {
-                    print(f, title);
-                    fclose(f);
+    /* If statistics only, ignore boards with multiple solutions */
+    if (1 < n) {
+        fprintf(f, "Board '%s' has multiple solutions\n", name);
+        return;
+    }
+
+    classification = classify(sv);
+    if (0 == opt_solve) {
+        fprintf(f, "%2d %-12s : %s\n", sv->pass, classification, name);
+    } else {
+        fprintf(f, "Solution(s) to '%s' [%s]\n", name, classification);
+        clear_moves(sv);
+        if (-1 != engine_solve(sv)) {
+            do {
+                print(sv, f, name);
+                if (opt_describe) {
+                    fprintf(f, "Solution history:\n");
+                    describe(sv, f);
                 }
-            }
-            if (0 == f) {
-                set_status("Error: failed to write the file!");
-            }
-        } else {
-            set_status("Error: no valid file name found!");
+            } while (-1 != engine_backtrack(sv)
+                     && -1 != engine_solve(sv));
         }
-    } else {
-        status_message("Save board operation aborted by the user.");
     }
 }
 
-/* Write default template to a user-given filename
+#if defined (HAVE_THREADS)
+/* Statistics over several threads (-j): the main thread reads boards
+ * into a ring of slots, and the jobs threads each take the next board
+ * in turn, with a solver context of their own, and write the outcome
+ * into its slot. The main thread prints the slots in the order of the
+ * boards, so the output is as with a single thread. An outcome too
+ * long for its slot (e.g. -v of a board with many solutions) is left
+ * for the main thread to redo when its turn comes.
  */
+#define MAX_JOBS                MAX_THREADS
+#define JOB_SLOTS               (4 * MAX_JOBS)
+#define JOB_OUTPUT              4096
+
+enum job_enum { jFree, jReady, jDone };
+
+typedef struct job_s {
+    enum job_enum   state;
+    int             unique;
+    int             houses;
+    int             overflow;       /* Outcome did not fit in 'output'   */
+    unsigned char   cell[81];
+    char            title[sizeof(title)];
+    char            output[JOB_OUTPUT];
+} job_t;
+
+typedef struct jobs_thread_s {
+    pthread_t       thread;
+    solver_t        sv;
+    solver_t        trial;
+} jobs_thread_t;
+
+static struct jobs_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;          /* A board was read, or no more      */
+    pthread_cond_t  done;           /* An outcome was written            */
+    long            read;           /* # boards read into slots          */
+    long            taken;          /* # boards taken by jobs threads    */
+    int             eof;            /* No more boards to read            */
+} jobs = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, 0, 0, 0
+};
+
+static job_t job_slot[JOB_SLOTS];
+static jobs_thread_t jobs_thread[MAX_JOBS];
+
+/* Jobs thread: classify or solve boards until there are no more */
 static
-void
-write_template (void)
+void *
+jobs_main (void * arg)
 {
-    if (0 == get_filename(templatefile,
-                            sizeof(templatefile),
-                            TEMPLATE_FALLBACK,
-                            "Write template")) {
+    jobs_thread_t * t = (jobs_thread_t *)arg;
+    job_t * job;
+    FILE * f;
+    long pos;
 
-            const char * p = trim_filename(templatefile,
-                                            sizeof(templatefile));
+    for (;;) {
+        pthread_mutex_lock(&jobs.lock);
+        while (jobs.taken == jobs.read && !jobs.eof) {
+            pthread_cond_wait(&jobs.ready, &jobs.lock);
+        }
+        if (jobs.taken == jobs.read) {
+            pthread_mutex_unlock(&jobs.lock);
+            return 0;
+        }
+        job = &job_slot[jobs.taken++ % JOB_SLOTS];
+        pthread_mutex_unlock(&jobs.lock);
 
-        if (p != NULL && *p) {
-            if (0 == write_default_template(p)) {
-                status_message("Template file successfully created!");
-            } else {
-                beep_status_message("Template file exists"
-                                    " or write error occurred!");
-            }
-        } else {
-            beep_status_message("No valid file name found!");
+        load_givens(&t->sv, job->cell, job->houses);
+        f = fmemopen(job->output, sizeof(job->output), "w");
+        job->overflow = 1;
+        if (0 != f) {
+            stat_board(&t->sv, &t->trial, job->unique, job->title, f);
+            pos = ftell(f);
+            job->overflow = pos < 0 || (long)sizeof(job->output) - 1 <= pos;
+            fclose(f);
         }
-    } else {
-        status_message("Write default template operation aborted by the user.");
+
+        pthread_mutex_lock(&jobs.lock);
+        job->state = jDone;
+        pthread_cond_broadcast(&jobs.done);
+        pthread_mutex_unlock(&jobs.lock);
     }
 }
 
-/* Open saved board(s)
+/* Read the boards, and print the outcomes of 'threads' jobs threads.
+ * Returns 0, or -1 if no thread could be started (nothing was read).
  */
 static
-void
-open_board (void)
+int
+stat_parallel (solver_t * sv, int threads)
 {
-    if (0 == get_filename(userfile,
-                          sizeof(userfile),
-                          DEFAULT_BOARD_NAME,
-                          "Open board")) {
-
-        const char * p = trim_filename(userfile,
-                                       sizeof(userfile));
+    static solver_t trial;
+    long printed = 0;
+    int i, unique, eof = 0;
+    job_t * job;
+
+    for (i = 0; i < threads; ++i) {
+        jobs_thread[i].sv.engine = sv->engine;
+        jobs_thread[i].sv.branching = sv->branching;
+        jobs_thread[i].sv.strategies = sv->strategies;
+        if (0 != pthread_create(&jobs_thread[i].thread, 0,
+                                jobs_main, &jobs_thread[i])) {
+            break;
+        }
+    }
+    threads = i;
+    if (0 == threads) {
+        return -1;
+    }
 
-        if (p != NULL && *p) {
-            if (opened != NULL) {
-                fclose(opened);
-                opened = NULL;
+    while (!eof || printed < jobs.read) {
+        /* Fill the free slots */
+        while (!eof && jobs.read < printed + JOB_SLOTS) {
+            if (0 != next_board(sv, precanned, &unique)) {
+                eof = 1;
+                break;
             }
-            opened = fopen(p, "r");
-            if (opened != NULL) {
-                load_board();
-            } else {
-                set_status("Error: failed to open the board!");
+            if (0 != opt_board && 0 != strcmp(opt_board, title)) {
+                continue;
             }
-        } else {
-            beep_status_message("No valid file name found!");
+            job = &job_slot[jobs.read % JOB_SLOTS];
+            for (i = 0; i < 81; ++i) {
+                job->cell[i] = (unsigned char)DIGIT(sv, i);
+            }
+            job->houses = sv->houses;
+            job->unique = unique;
+            strcpy(job->title, title);
+            job->state = jReady;
+
+            pthread_mutex_lock(&jobs.lock);
+            ++jobs.read;
+            pthread_cond_signal(&jobs.ready);
+            pthread_mutex_unlock(&jobs.lock);
+        }
+        if (eof) {
+            pthread_mutex_lock(&jobs.lock);
+            jobs.eof = 1;
+            pthread_cond_broadcast(&jobs.ready);
+            pthread_mutex_unlock(&jobs.lock);
+        }
+        if (printed == jobs.read) {
+            continue;
         }
-    } else {
-        status_message("Open board operation aborted by the user.");
-    }
-}
 
-/* Rename the board title.
- * Returns a process exit code.
- */
-static
-void
-rename_board_title (void)
-{
-    char new_title[80];
-    new_title[0]='\0';
-    if (0 == get_title(new_title,
-                        sizeof(new_title),
-                        title,
-                        "Rename the board title")) {
-        const char *    nt;
-        size_t          ts = sizeof(new_title);
-        if (ts > sizeof(title)) {
-            ts = sizeof(title);
+        /* Print the outcome of the oldest board, once done */
+        job = &job_slot[printed % JOB_SLOTS];
+        pthread_mutex_lock(&jobs.lock);
+        while (jDone != job->state) {
+            pthread_cond_wait(&jobs.done, &jobs.lock);
         }
-        nt = trim_titlename(new_title, ts);
-        if (nt != NULL && *nt != '\0') {
-            strcpy(title, nt);
-            write_title(title);
+        pthread_mutex_unlock(&jobs.lock);
+        if (job->overflow) {
+            load_givens(sv, job->cell, job->houses);
+            stat_board(sv, &trial, job->unique, job->title, stdout);
+        } else {
+            fputs(job->output, stdout);
         }
-        move_to(curx, cury);
+        job->state = jFree;
+        ++printed;
+    }
+
+    for (i = 0; i < threads; ++i) {
+        pthread_join(jobs_thread[i].thread, 0);
     }
+    return 0;
 }
+#endif
 
 /* Generate statistics from boards in 'filename', and/or solve them.
  * Returns a process exit code.
@@ -3401,45 +7081,166 @@ static
 int
 gen_statistics (void)
 {
+    static solver_t trial;
+    solver_t * sv = &solver;
     int retval = 0;
     if (0 == precanned) {
         fprintf(stderr, "Error: no precanned boards loaded\n");
         retval = -1;
     } else {
-        const char * classification;
+        int unique;
+
+        fseek (precanned, 0, SEEK_SET);
+        batch.n = batch.next = batch.eof = 0;
+#if defined (HAVE_THREADS)
+        /* Without a thread to run, fall back to a single one */
+        if (1 < opt_jobs && 0 == stat_parallel(sv, opt_jobs)) {
+            return retval;
+        }
+#endif
+        while (0 == next_board(sv, precanned, &unique)) {
+            if (0 != opt_board && 0 != strcmp(opt_board, title)) {
+                continue;
+            }
+            if (0 != opt_cubes) {
+                split_cubes(sv, opt_cubes);
+                continue;
+            }
+            stat_board(sv, &trial, unique, title, stdout);
+        }
+    }
+    return retval;
+}
+
+/* Solve the boards of 'filename' ("-" for stdin), 81 squares to a
+ * line (digits, with '.' or '0' for blanks), writing each solution as
+ * a line of 81 digits. Every line read gives one line written: blank
+ * lines and comments are copied, and a line that is not a board or has
+ * no solution is written as 81 '.' (and reported on stderr). Lines are
+ * taken BATCH at a time, so that the boards singles solve never reach
+ * the engines. Returns a process exit code.
+ */
+#define LINE_BOARD  0
+#define LINE_TEXT   1       /* Blank line or comment, copied */
+#define LINE_BAD    2       /* Not a board */
+#define LINE_FAILED 3       /* Board without a solution */
+
+static
+int
+line_boards (const char * filename)
+{
+    static char inbuf[1 << 16], outbuf[1 << 16];
+    static unsigned char cell[BATCH][81], solved[BATCH];
+    static char buf[128], text[BATCH][128 + 1];
+    static int kind[BATCH];
+    static solver_t trial;
+    solver_t * sv = &solver;
+    FILE * f = stdin;
+    const char * p;
+    long lineno = 0;
+    int i, k, l, n, c, retval = 0;
+
+    if (0 != strcmp("-", filename)) {
+        f = fopen(filename, "r");
+        if (0 == f) {
+            fprintf(stderr, "Error: failed to open '%s'\n", filename);
+            return 1;
+        }
+    }
+    setvbuf(f, inbuf, _IOFBF, sizeof(inbuf));
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
 
-        fseek (precanned, 0, SEEK_SET);
-        while (0 == read_board(precanned, 0)) {
-            /* Ignore insoluble boards */
-            if (-1 == solve()) {
-                printf("Board '%s' has no solution\n", title);
+    for (k = 1; 0 != k;) {
+        /* Read up to BATCH lines; those which are not boards are kept
+         * as they are to be written (the squares of the board left
+         * empty, which singles never solve)
+         */
+        for (k = 0; k < BATCH && 0 != fgets(buf, sizeof(buf), f); ++k) {
+            n = (int)strlen(buf);
+            if (0 < n && '\n' != buf[n - 1]) {
+                /* Long line; only its first 81 characters matter */
+                while (EOF != (c = getc(f)) && '\n' != c) {
+                    ;
+                }
+            }
+            ++lineno;
+            for (p = buf; isspace(*p) && '\n' != *p; ++p) {
+                ;
+            }
+            if ('#' == *p || '\n' == *p || '\0' == *p) {
+                memset(cell[k], 0x00, sizeof(cell[k]));
+                sprintf(text[k], "%.*s\n", (int)strcspn(buf, "\n"), buf);
+                kind[k] = LINE_TEXT;
                 continue;
             }
-
-            /* If statistics only, ignore boards with multiple solutions */
-            if (0 == opt_solve && -1 != backtrack() && 0 == solve()) {
-                printf("Board '%s' has multiple solutions\n", title);
+            for (i = 0; i < 81; ++i) {
+                if ('1' <= p[i] && p[i] <= '9') {
+                    cell[k][i] = (unsigned char)(p[i] - '0');
+                } else if ('.' == p[i] || '0' == p[i]) {
+                    cell[k][i] = 0;
+                } else {
+                    break;
+                }
+            }
+            if (81 != i) {
+                memset(cell[k], 0x00, sizeof(cell[k]));
+                kind[k] = LINE_BAD;
                 continue;
             }
+            kind[k] = LINE_BOARD;
+        }
+        batch_singles(cell, k, solved);
 
-            classification = classify();
-            if (0 == opt_solve) {
-                printf("%2d %-12s : %s\n", pass, classification, title);
-            } else {
-                printf("Solution(s) to '%s' [%s]\n", title, classification);
-                clear_moves();
-                if (-1 != solve()) {
-                    do {
-                        print(stdout, title);
-                        if (opt_describe) {
-                            printf("Solution history:\n");
-                            describe(stdout);
-                        }
-                    } while (-1 != backtrack() && -1 != solve());
+        for (l = 0; l < k; ++l) {
+            if (LINE_TEXT == kind[l]) {
+                fputs(text[l], stdout);
+                continue;
+            }
+            if (LINE_BAD == kind[l]) {
+                fprintf(stderr, "Error: line %ld is not a board\n",
+                        lineno - k + l + 1);
+                retval = 1;
+            }
+            if (LINE_BOARD == kind[l] && !solved[l]) {
+                sv->houses = 0;
+                reset(sv);
+                for (n = i = 0; 0 == n && i < 81; ++i) {
+                    if (0 != cell[l][i]) {
+                        n = fill(sv, i, cell[l][i]);
+                        sv->board[i] |= FIXED;
+                    }
+                }
+                for (i = 0; 0 == n && i < sv->idx_history; ++i) {
+                    sv->history[i] |= FIXED;
+                }
+                if (0 == n && eAuto == opt_engine) {
+                    dispatch(sv, &trial);
+                }
+                if (0 != n || (eSearch == sv->engine
+                               ? -1 == first_completion(sv)
+                               : 0 == count_solutions(sv, 1))) {
+                    fprintf(stderr, "Error: line %ld has no solution\n",
+                            lineno - k + l + 1);
+                    kind[l] = LINE_FAILED;
+                    retval = 1;
+                } else {
+                    for (i = 0; i < 81; ++i) {
+                        cell[l][i] = (unsigned char)DIGIT(sv, i);
+                    }
                 }
             }
+            for (i = 0; i < 81; ++i) {
+                text[l][i] = (char)(LINE_BOARD == kind[l]
+                                    ? '0' + cell[l][i] : '.');
+            }
+            text[l][81] = '\n';
+            fwrite(text[l], 1, 82, stdout);
         }
     }
+    fflush(stdout);
+    if (stdin != f) {
+        fclose(f);
+    }
     return retval;
 }
 
@@ -3517,7 +7318,29 @@ usage (void)
             "    -c<class>    generate a board until it finds a board of the\n"
             "                 specified class. Supported classes are:\n"
             "                    %s, %s, %s, %s, and %s\n"
+            "    -b<title>    only the precanned board titled <title>\n"
+            "                 (with -s, -v)\n"
+            "    -B<policy>   set how the search engine picks a guess\n"
+            "                 (with -g, -s, -v); supported policies are:\n"
+            "                    mrv        (default) square with fewest\n"
+            "                               digits allowed\n"
+            "                    degree     mrv, then most unknown squares\n"
+            "                               in its row, column and block\n"
+            "                    digit      mrv, or a digit with fewer\n"
+            "                               positions in a row, column\n"
+            "                               or block\n"
+            "    -C<limit>    count solutions of precanned boards up to\n"
+            "                 <limit> (with -s)\n"
             "    -d           describe solution steps (with -v)\n"
+            "    -E<engine>   set the engine for solving/counting boards\n"
+            "                 (with -g, -s, -v); supported engines are:\n"
+            "                    search     (default) deterministic solver\n"
+            "                               and backtracking\n"
+            "                    dlx        dancing links exact cover\n"
+            "                    backjump   singles, backjumping to the\n"
+            "                               choice to blame, and nogoods\n"
+            "                    auto       one of the above for each\n"
+            "                               board (with -s, -v)\n"
             "    -f<format>   set output format; supported formats are:\n"
             "                    standard   (std)    <default format>\n"
             "                    compact\n"
@@ -3525,9 +7348,33 @@ usage (void)
             "                    postscript (ps)\n"
             "                    html\n"
             "    -g[<num>]    generate <num> board(s), and print on stdout\n"
+            "    -G<rows>x<cols>\n"
+            "                 boards of boxes <rows> by <cols> (e.g. 4x4\n"
+            "                 for 16x16 boards), with -g, -s or -v\n"
+            "    -j<threads>  generate, classify or solve boards with\n"
+            "                 <threads> threads taking turns (with -g,\n"
+            "                 -s, -v)\n"
+            "    -k<cubes>    split precanned boards into at least <cubes>\n"
+            "                 boards, printed on stdout (with -s)\n"
+            "    -l           look ahead before guessing a digit (with -g,\n"
+            "                 -s, -v and the search engine)\n"
+            "    -L<filename> solve the boards of <filename> (- for stdin),\n"
+            "                 one of 81 squares to a line, printing each\n"
+            "                 solution as a line\n"
+            "    -m<filename> merge the counts of the boards split with -k,\n"
+            "                 from the output of -s -C (- for stdin)\n"
             "    -n           no random boards (requires precanned boards)\n"
+            "    -p<threads>  count the solutions of each board with\n"
+            "                 <threads> threads (with -s, -v; search\n"
+            "                 engine only)\n"
             "    -r           restricted: don't allow boards to be saved\n"
+            "    -R[<num>]    with -g, restart a board after <num> guesses\n"
+            "                 (default 100), times the Luby sequence\n"
             "    -s           calculate statistics for precanned boards\n"
+            "    -S<seed>[:<first>]\n"
+            "                 seed the random numbers, so that boards\n"
+            "                 numbered from <first> (default 0) repeat\n"
+            "                 (with -g, and the game)\n"
             "    -t<filename> template file\n"
             "    -v           solve precanned boards\n"
             "    -w           write out the default template\n"
@@ -3543,13 +7390,14 @@ usage (void)
 
 void request_hint (void)
 {
+    solver_t * sv = &solver;
     ++req_hints;
     if (have_hint) {
         clear_hints();
     }
     if (-1 == num_hints) {
         last_hint = -1;
-        num_hints = findhints();
+        num_hints = findhints(sv);
     }
     if (0 == num_hints) {
         set_status("No hints available!");
@@ -3559,38 +7407,38 @@ void request_hint (void)
 
         if (1 < num_hints) {
             do {
-                i = rand() % num_hints;
+                i = rng_below(&rng, num_hints);
             } while (i == last_hint);
         } else {
             i = 0;
         }
-        idx = GET_INDEX(possible[last_hint = i]);
+        idx = GET_INDEX(sv->possible[last_hint = i]);
 
         /* Count # possible ways of expressing hint */
-        if (0 != (HINT_ROW & possible[i])) {
+        if (0 != (HINT_ROW & sv->possible[i])) {
             ++n;
         }
-        if (0 != (HINT_COLUMN & possible[i])) {
+        if (0 != (HINT_COLUMN & sv->possible[i])) {
             ++n;
         }
-        if (0 != (HINT_BLOCK & possible[i])) {
+        if (0 != (HINT_BLOCK & sv->possible[i])) {
             ++n;
         }
         assert(0 < n);
         if (1 < n) {
-            n = 1 + rand() % n;
+            n = 1 + rng_below(&rng, n);
         }
-        if (0 != (HINT_ROW & possible[i])) {
+        if (0 != (HINT_ROW & sv->possible[i])) {
             if (0 == --n) {
                 row_hint(ROW(idx));
             }
         }
-        if (0 != (HINT_COLUMN & possible[i])) {
+        if (0 != (HINT_COLUMN & sv->possible[i])) {
             if (0 == --n) {
                 column_hint(COLUMN(idx));
             }
         }
-        if (0 != (HINT_BLOCK & possible[i])) {
+        if (0 != (HINT_BLOCK & sv->possible[i])) {
             if (0 == --n) {
                 block_hint(IDX_BLOCK(ROW(idx), COLUMN(idx)));
             }
@@ -3598,12 +7446,12 @@ void request_hint (void)
         if (opt_spoilerhint) {
             /* Useful for testing... */
             sprintf(statusline, "%d @ row %d, column %d",
-                        GET_DIGIT(possible[i]),
+                        GET_DIGIT(sv->possible[i]),
                         ROW(idx)+1, COLUMN(idx)+1);
             set_status(statusline);
         } else if (10 < req_hints || 2 * num_hints < req_hints) {
             sprintf(statusline, "(try the digit %d)",
-                        GET_DIGIT(possible[i]));
+                        GET_DIGIT(sv->possible[i]));
             set_status(statusline);
         }
     }
@@ -3626,7 +7474,8 @@ evaluate_options (int argc, char **argv)
                 }
                 open_precanned(arg);
                 strcpy(userfile, arg);  /* Save the filename */
-                if (0 == precanned || 0 == n_precanned) {
+                /* With -G, boards are only read later (see below) */
+                if (0 == precanned) {
                     fprintf(stderr, "Error: failed to open '%s'\n", arg);
                     ret_err = 1;
                     /* will exit */
@@ -3635,6 +7484,26 @@ evaluate_options (int argc, char **argv)
             } else {
                 while ('\0' != *++arg) {
                     switch (*arg) {
+                        case 'b':
+                            if ('\0' == arg[1]) {
+                                if (0 == *(argv+1)) {
+                                    fprintf(stderr,
+                                            "Error:"
+                                            " expected argument after '-b'\n");
+                                    ret_err = 1;
+                                    /* will exit */
+                                    /* dummy to force termination */
+                                    arg = "x";
+                                    break;
+                                }
+                                opt_board = *++argv;
+                                --argc;
+                            } else {
+                                opt_board = arg + 1;
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
                         case 'c':
                             /* No need for strdup, since the underlying
                              * memory in the environment will not go away. */
@@ -3659,9 +7528,98 @@ evaluate_options (int argc, char **argv)
                             /* dummy to force termination */
                             arg = "x";
                             break;
+                        case 'B':
+                            if ('\0' == arg[1]) {
+                                if (0 == *(argv+1)) {
+                                    fprintf(stderr,
+                                            "Error:"
+                                            " expected argument after '-B'\n");
+                                    ret_err = 1;
+                                    /* will exit */
+                                    /* dummy to force termination */
+                                    arg = "x";
+                                    break;
+                                }
+                                arg = *++argv;
+                                --argc;
+                            } else {
+                                ++arg;
+                            }
+                            if (0 == strcmp("mrv", arg)) {
+                                opt_branching = bMRV;
+                            } else if (0 == strcmp("degree", arg)) {
+                                opt_branching = bDegree;
+                            } else if (0 == strcmp("digit", arg)) {
+                                opt_branching = bDigit;
+                            } else {
+                                fprintf(stderr,
+                                        "Error:"
+                                        " '%s' is an unknown branching policy\n",
+                                        arg);
+                                ret_err = 1;
+                                /* will exit */
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
+                        case 'C':
+                            if (isdigit(arg[1])) {
+                                opt_count = atoi(arg + 1);
+                            } else if ('\0' == arg[1]
+                                      && 0 != *(argv+1)
+                                      && isdigit(**(argv+1))) {
+                                opt_count = atoi(*++argv);
+                                --argc;
+                            }
+                            if (opt_count <= 0) {
+                                fprintf(stderr,
+                                        "Error:"
+                                        " expected a positive limit"
+                                        " after '-C'\n");
+                                ret_err = 1;
+                                /* will exit */
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
                         case 'd':
                             opt_describe = 1;
                             break;
+                        case 'E':
+                            if ('\0' == arg[1]) {
+                                if (0 == *(argv+1)) {
+                                    fprintf(stderr,
+                                            "Error:"
+                                            " expected argument after '-E'\n");
+                                    ret_err = 1;
+                                    /* will exit */
+                                    /* dummy to force termination */
+                                    arg = "x";
+                                    break;
+                                }
+                                arg = *++argv;
+                                --argc;
+                            } else {
+                                ++arg;
+                            }
+                            if (0 == strcmp("search", arg)) {
+                                opt_engine = eSearch;
+                            } else if (0 == strcmp("dlx", arg)) {
+                                opt_engine = eDLX;
+                            } else if (0 == strcmp("backjump", arg)) {
+                                opt_engine = eBackjump;
+                            } else if (0 == strcmp("auto", arg)) {
+                                opt_engine = eAuto;
+                            } else {
+                                fprintf(stderr,
+                                        "Error: '%s' is an unknown engine\n",
+                                        arg);
+                                ret_err = 1;
+                                /* will exit */
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
                         case 'f':
                             if ('\0' == arg[1]) {
                                 arg = *++argv;
@@ -3705,10 +7663,195 @@ evaluate_options (int argc, char **argv)
                                 --argc;
                             }
                             break;
+                        case 'G':
+                            if ('\0' == arg[1] && 0 != *(argv+1)) {
+                                arg = *++argv;
+                                --argc;
+                            } else {
+                                ++arg;
+                            }
+                            if (2 != sscanf(arg, "%dx%d",
+                                            &opt_grid_rows, &opt_grid_cols)
+                                || opt_grid_rows < 2 || opt_grid_cols < 2
+                                || GRID_MAX < opt_grid_rows * opt_grid_cols) {
+                                fprintf(stderr,
+                                        "Error:"
+                                        " expected boxes <rows>x<cols>,"
+                                        " of 4 to %d squares, after '-G'\n",
+                                        GRID_MAX);
+                                ret_err = 1;
+                                /* will exit */
+                            } else if (3 == opt_grid_rows
+                                       && 3 == opt_grid_cols) {
+                                opt_grid_rows = opt_grid_cols = 0;
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
                         case 'h': opt_spoilerhint = 1; break;
+                        case 'j':
+                            if (isdigit(arg[1])) {
+                                opt_jobs = atoi(arg + 1);
+                            } else if ('\0' == arg[1]
+                                      && 0 != *(argv+1)
+                                      && isdigit(**(argv+1))) {
+                                opt_jobs = atoi(*++argv);
+                                --argc;
+                            } else {
+                                opt_jobs = 0;
+                            }
+#if defined (HAVE_THREADS)
+                            if (opt_jobs <= 0 || MAX_JOBS < opt_jobs) {
+                                fprintf(stderr,
+                                        "Error:"
+                                        " expected 1 to %d threads"
+                                        " after '-j'\n", MAX_JOBS);
+                                ret_err = 1;
+                                /* will exit */
+                            }
+#else
+                            fprintf(stderr,
+                                    "Error: option -j is not supported"
+                                    " by this build\n");
+                            ret_err = 1;
+                            /* will exit */
+#endif
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
+                        case 'k':
+                            if (isdigit(arg[1])) {
+                                opt_cubes = atoi(arg + 1);
+                            } else if ('\0' == arg[1]
+                                      && 0 != *(argv+1)
+                                      && isdigit(**(argv+1))) {
+                                opt_cubes = atoi(*++argv);
+                                --argc;
+                            }
+                            if (opt_cubes <= 0 || MAX_CUBES < opt_cubes) {
+                                fprintf(stderr,
+                                        "Error:"
+                                        " expected 1 to %d cubes"
+                                        " after '-k'\n", MAX_CUBES);
+                                ret_err = 1;
+                                /* will exit */
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
+                        case 'l': opt_lookahead = 1; break;
+                        case 'L':
+                            if ('\0' == arg[1]) {
+                                if (0 == *(argv+1)) {
+                                    fprintf(stderr,
+                                            "Error:"
+                                            " expected argument after '-L'\n");
+                                    ret_err = 1;
+                                    /* will exit */
+                                    /* dummy to force termination */
+                                    arg = "x";
+                                    break;
+                                }
+                                opt_lines = *++argv;
+                                --argc;
+                            } else {
+                                opt_lines = arg + 1;
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
+                        case 'm':
+                            if ('\0' == arg[1]) {
+                                if (0 == *(argv+1)) {
+                                    fprintf(stderr,
+                                            "Error:"
+                                            " expected argument after '-m'\n");
+                                    ret_err = 1;
+                                    /* will exit */
+                                    /* dummy to force termination */
+                                    arg = "x";
+                                    break;
+                                }
+                                opt_merge = *++argv;
+                                --argc;
+                            } else {
+                                opt_merge = arg + 1;
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
                         case 'n': opt_random = 0; break;
+                        case 'p':
+                            if (isdigit(arg[1])) {
+                                opt_threads = atoi(arg + 1);
+                            } else if ('\0' == arg[1]
+                                      && 0 != *(argv+1)
+                                      && isdigit(**(argv+1))) {
+                                opt_threads = atoi(*++argv);
+                                --argc;
+                            } else {
+                                opt_threads = 0;
+                            }
+#if defined (HAVE_THREADS)
+                            if (opt_threads <= 0
+                                || MAX_THREADS < opt_threads) {
+                                fprintf(stderr,
+                                        "Error:"
+                                        " expected 1 to %d threads"
+                                        " after '-p'\n", MAX_THREADS);
+                                ret_err = 1;
+                                /* will exit */
+                            }
+#else
+                            fprintf(stderr,
+                                    "Error: option -p is not supported"
+                                    " by this build\n");
+                            ret_err = 1;
+                            /* will exit */
+#endif
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
                         case 'r': opt_restrict = 1; break;
+                        case 'R':
+                            opt_restarts = 100;
+                            if (isdigit(arg[1])) {
+                                opt_restarts = atoi(arg + 1);
+                                /* dummy to force termination */
+                                arg = "x";
+                            } else if ('\0' == arg[1]
+                                      && 0 != *(argv+1)
+                                      && isdigit(**(argv+1))) {
+                                opt_restarts = atoi(*++argv);
+                                --argc;
+                            }
+                            break;
                         case 's': opt_statistics = 1; break;
+                        case 'S':
+                            if ('\0' == arg[1] && 0 != *(argv+1)) {
+                                arg = *++argv;
+                                --argc;
+                            } else {
+                                ++arg;
+                            }
+                            if (isdigit(*arg)) {
+                                rng_base = (zkey_t)strtozkey(arg, &arg, 0);
+                                opt_seeded = 1;
+                            }
+                            if (':' == *arg && isdigit(arg[1])) {
+                                opt_first = strtol(arg + 1, &arg, 10);
+                            }
+                            if (0 == opt_seeded || '\0' != *arg) {
+                                fprintf(stderr,
+                                        "Error:"
+                                        " expected <seed>[:<first>]"
+                                        " after '-S'\n");
+                                ret_err = 1;
+                                /* will exit */
+                            }
+                            /* dummy to force termination */
+                            arg = "x";
+                            break;
                         case 't':
                             if ('\0' == arg[1]) {
                                 if (0 == *(argv+1)) {
@@ -3759,6 +7902,12 @@ evaluate_options (int argc, char **argv)
                 break;
             }
         }
+        /* Only 9x9 boards were counted by open_precanned() */
+        if (0 == ret_err && 0 != precanned && 0 == n_precanned
+            && 0 == opt_grid_rows) {
+            fprintf(stderr, "Error: failed to open '%s'\n", userfile);
+            ret_err = 1;
+        }
     }
     return ret_err;
 }
@@ -3767,6 +7916,7 @@ static
 void
 play_the_game (void)
 {
+    solver_t * sv = &solver;
     int ch = ' ';
     while ('q' != ch) {
         wrefresh(stdscr);
@@ -3791,9 +7941,9 @@ play_the_game (void)
             case '7':
             case '8':
             case '9': /* clear location, or add digit to board */
-                if (!IS_FIXED(INDEX(cury, curx))) {
+                if (!IS_FIXED(sv, INDEX(cury, curx))) {
                     num_hints = -1;
-                    fillx(INDEX(cury, curx), ch - '0');
+                    fillx(sv, INDEX(cury, curx), ch - '0');
                     addch('0' == ch ? '.' : ch);
                     move_to(curx, cury);
                     if (have_hint) {
@@ -3840,17 +7990,17 @@ play_the_game (void)
                 }
                 break;
             case 'u': /* undo last move */
-                if (idx_history <= 0
-                    || history[idx_history - 1] & FIXED) {
-                    assert(idx_history >= 0);
+                if (sv->idx_history <= 0
+                    || sv->history[sv->idx_history - 1] & FIXED) {
+                    assert(sv->idx_history >= 0);
                     beep();
                 } else {
-                    int i;
+                    int i, idx;
                     /* Don't ignore last reference (if exists) */
-                    for (i = --idx_history - 1; 0 <= i; --i) {
-                        if (GET_INDEX(history[i])
-                            == GET_INDEX(history[idx_history])) {
-                            history[i] &= ~IGNORED;
+                    for (i = --sv->idx_history - 1; 0 <= i; --i) {
+                        if (GET_INDEX(sv->history[i])
+                            == GET_INDEX(sv->history[sv->idx_history])) {
+                            sv->history[i] &= ~IGNORED;
                             break;
                         }
                     }
@@ -3859,14 +8009,14 @@ play_the_game (void)
                         clear_hints();
                     }
                     req_hints = 0;
-                    reapply();
+                    reapply(sv);
                     render();
-                    if (history[idx_history - 1] & FIXED) {
+                    if (sv->history[sv->idx_history - 1] & FIXED) {
                         curx = cury = 8;
                         move_next();
                     } else {
-                        move_to (COLUMN(GET_INDEX(history[idx_history])),
-                                 ROW(GET_INDEX(history[idx_history])));
+                        idx = GET_INDEX(sv->history[sv->idx_history]);
+                        move_to (COLUMN(idx), ROW(idx));
                     }
                 }
                 break;
@@ -3876,7 +8026,7 @@ play_the_game (void)
                 if (have_hint) {
                     clear_hints();
                 }
-                reset();
+                reset(sv);
                 render();
                 write_title(0);
                 move_to(0, 0);
@@ -3886,7 +8036,7 @@ play_the_game (void)
                 redrawwin(stdscr);
                 break;
             case 'f': /* fix squares (if possible) */
-                if (0 == idx_history || 0 != (history[0] & FIXED)) {
+                if (0 == sv->idx_history || 0 != (sv->history[0] & FIXED)) {
                     break;
                 }
                 if (0 != fix()) {
@@ -3898,19 +8048,19 @@ play_the_game (void)
                 if (have_hint) {
                     clear_hints();
                 }
-                reset();
+                reset(sv);
                 render();
                 write_title(0);
                 wrefresh(stdscr);
                 load_board();
                 break;
             case 'v': /* show solution */
-                clear_moves();
+                clear_moves(sv);
                 if (have_hint) {
                     clear_hints();
                 }
                 num_hints = -1;
-                if (0 == solve()) {
+                if (0 == solve(sv)) {
                     completed = 1;
                 } else {
                     beep_status_message("This board has no solution!");
@@ -3920,7 +8070,7 @@ play_the_game (void)
                 break;
 
             case 'r': /* restart the same board */
-                clear_moves();
+                clear_moves(sv);
                 render();
                 curx = 8;
                 cury = 8;
@@ -3965,7 +8115,7 @@ play_the_game (void)
 
         /* Check for a solution */
         if (0 == completed) {
-            if (is_complete() && 0 == fix()) {
+            if (is_complete(sv) && 0 == fix()) {
                 time_t end_time;
                 time( &end_time );
                 end_time -= start_time;
@@ -3986,18 +8136,94 @@ play_the_game (void)
 int
 main (int argc, char **argv)
 {
+    solver_t * sv = &solver;
     program = argv[0];
+    init_zobrist();
 
     /* Limited support for options */
     if (0 != evaluate_options(argc, argv)) {
         cleanup_curses_and_more();
         exit(1);
     }
+    if (0 == opt_seeded) {
+        rng_base = (zkey_t)time(0) << 32 ^ (zkey_t)getpid();
+    }
+    rng_seed(&rng, ~(zkey_t)0);
     if (0 != opt_statistics && 0 != opt_generate) {
         fprintf(stderr, "Error: Cannot set both -g and -s options\n");
         cleanup_curses_and_more();
         return -1;
     }
+    if (0 != opt_count && 0 == opt_statistics) {
+        fprintf(stderr, "Error: option -C requires -s\n");
+        cleanup_curses_and_more();
+        return -1;
+    }
+    if ((0 != opt_cubes && (0 == opt_statistics || 0 != opt_count))
+        || (0 != opt_board && 0 == opt_statistics && 0 == opt_solve)) {
+        fprintf(stderr, "Error: option -k requires -s (without -C),"
+                        " and -b requires -s or -v\n");
+        cleanup_curses_and_more();
+        return -1;
+    }
+    if (1 < opt_jobs
+        && ((0 == opt_statistics && 0 == opt_solve && 0 == opt_generate)
+            || 0 != opt_cubes || 1 < opt_threads || 0 != opt_grid_rows)) {
+        fprintf(stderr, "Error: option -j requires -g, -s or -v, and cannot"
+                        " be used with -k, -p or -G\n");
+        cleanup_curses_and_more();
+        return -1;
+    }
+    if (1 < opt_threads && eSearch != opt_engine) {
+        fprintf(stderr, "Error: option -p counts with the search engine,"
+                        " and cannot be used with -E dlx, backjump or"
+                        " auto\n");
+        cleanup_curses_and_more();
+        return -1;
+    }
+    if (0 != opt_merge) {
+        int retval = merge_counts(opt_merge);
+        cleanup_curses_and_more();
+        return retval;
+    }
+    if (0 != opt_grid_rows) {
+        int retval;
+        if ((0 == opt_generate && 0 == opt_statistics && 0 == opt_solve)
+            || 0 != opt_cubes || 1 < opt_threads || 0 != requested_class
+            || fPostScript == opt_format || fHTML == opt_format) {
+            fprintf(stderr, "Error: option -G requires -g, -s or -v,"
+                            " and cannot be used with -c, -k, -p,"
+                            " or the ps and html formats\n");
+            cleanup_curses_and_more();
+            return -1;
+        }
+        retval = grid_boards();
+        cleanup_curses_and_more();
+        return retval;
+    }
+
+    /* With -E auto, gen_statistics() and line_boards() pick the engine
+     * for each board
+     */
+    sv->engine = eAuto == opt_engine ? eSearch : opt_engine;
+    sv->branching = opt_branching;
+    sv->strategies = STRATEGY_FISH | STRATEGY_SUBSETS
+                     | (opt_lookahead ? STRATEGY_PROBE : 0)
+                     | (eBackjump == opt_engine ? STRATEGY_BACKJUMP : 0);
+
+    if (0 != opt_lines) {
+        int retval;
+        if (0 != opt_generate || 0 != opt_statistics || 0 != opt_solve
+            || 0 != precanned) {
+            fprintf(stderr, "Error: option -L cannot be used with -g, -s,"
+                            " -v, or a precanned file\n");
+            cleanup_curses_and_more();
+            return -1;
+        }
+        retval = line_boards(opt_lines);
+        cleanup_curses_and_more();
+        return retval;
+    }
 
     if (0 == precanned) {
         open_precanned(PRECANNED);
@@ -4015,8 +8241,6 @@ main (int argc, char **argv)
         return retval;
     }
 
-    srand((unsigned int)(time(0) ^ getpid()));
-
     if (0 == ftmplt) {
         open_template(TEMPLATE);
 
@@ -4037,6 +8261,9 @@ main (int argc, char **argv)
     }
 
     if (0 != opt_generate) {
+        static gen_t gen;
+        int i;
+
         /* -g0 generates many boards */
         if (0 == num_generate) {
             /* changed from --num_generate, to make it
@@ -4045,9 +8272,17 @@ main (int argc, char **argv)
              */
             num_generate = 10000;
         }
-        while (0 != num_generate--) {
-            generate();
-            print(stdout, title);
+#if defined (HAVE_THREADS)
+        /* Without a thread to run, fall back to a single one */
+        if (1 < opt_jobs && 0 == gen_parallel(sv, num_generate, opt_jobs)) {
+            cleanup_curses_and_more();
+            return 0;
+        }
+#endif
+        for (i = 0; i < num_generate; ++i) {
+            rng_seed(&gen.rng, (zkey_t)(opt_first + i));
+            generate(sv, &gen);
+            print(sv, stdout, gen.title);
         }
         cleanup_curses_and_more();
         return 0;